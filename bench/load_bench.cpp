@@ -0,0 +1,577 @@
+// ============================================================================
+// BENCHMARK: End-to-End Load Generator
+// ============================================================================
+// Drives a running ocr_server over gRPC and reports throughput, latency
+// percentiles and errors as one JSON object, so runs against two builds can
+// be diffed. The corpus is either a directory of images or synthetic text
+// pages rendered with a built-in 5x7 bitmap font (no files needed).
+//
+// Load models:
+//   closed loop (default)  --concurrency callers, each sends its next
+//                          request as soon as the previous one completes
+//   open loop (--rate=R)   requests are scheduled at R per second regardless
+//                          of completions; latency is measured from the
+//                          scheduled time, so a stalled server is not hidden
+//                          by callers that stop sending (coordinated omission)
+// RPC modes:
+//   image  one ProcessImage call per request
+//   batch  one ProcessBatch stream per caller with --window images in flight
+//
+// Usage: ocr_bench [--flag=value ...]
+//   --target=HOST:PORT   server address (default localhost:50051)
+//   --corpus=DIR         replay images from DIR instead of synthetic pages
+//   --synthetic=N        synthetic pages to render (default 16)
+//   --lines=N            text lines per synthetic page (default 20)
+//   --mode=image|batch   RPC mode (default image)
+//   --requests=N         measured requests (default 200)
+//   --warmup=N           unmeasured requests sent first (default 0)
+//   --concurrency=N      callers / streams (default 4)
+//   --rate=R             open-loop arrivals per second (default 0 = closed loop)
+//   --window=N           in-flight images per batch stream (default 8)
+//   --deadline_ms=N      per-request deadline (default 60000)
+//   --bust_cache=0|1     make every request's bytes unique (default 1)
+//   --label=NAME         copied into the JSON output
+#include "ocr_service.grpc.pb.h"
+#include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string target = "localhost:50051";
+    std::string corpus;
+    int synthetic = 16;
+    int lines = 20;
+    std::string mode = "image";
+    int requests = 200;
+    int warmup = 0;
+    int concurrency = 4;
+    double rate = 0;
+    int window = 8;
+    int deadline_ms = 60000;
+    bool bust_cache = true;
+    std::string label;
+};
+
+struct CorpusImage {
+    std::string name;
+    std::string data;
+};
+
+// ----------------------------------------------------------------------------
+// Synthetic corpus: uppercase text rendered into 8-bit PGM pages
+// ----------------------------------------------------------------------------
+struct Glyph {
+    char c;
+    uint8_t rows[7];  // Top to bottom; bit 4 is the leftmost column
+};
+
+const Glyph kFont[] = {
+    {'0', {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}},
+    {'1', {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'2', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}},
+    {'3', {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},
+    {'4', {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}},
+    {'5', {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},
+    {'6', {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}},
+    {'7', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+    {'8', {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}},
+    {'9', {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},
+    {'A', {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11}},
+    {'B', {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}},
+    {'C', {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}},
+    {'D', {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}},
+    {'E', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}},
+    {'F', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}},
+    {'G', {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}},
+    {'H', {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},
+    {'I', {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'J', {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}},
+    {'K', {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}},
+    {'L', {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}},
+    {'M', {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}},
+    {'N', {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}},
+    {'O', {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}},
+    {'P', {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}},
+    {'Q', {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}},
+    {'R', {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}},
+    {'S', {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}},
+    {'T', {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},
+    {'U', {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}},
+    {'V', {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}},
+    {'W', {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}},
+    {'X', {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}},
+    {'Y', {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}},
+    {'Z', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}},
+    {'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}},
+    {',', {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}},
+};
+
+const char* const kWords[] = {
+    "INVOICE", "TOTAL", "AMOUNT", "DATE", "ORDER", "NUMBER", "SHIP", "TO",
+    "CUSTOMER", "ACCOUNT", "BALANCE", "DUE", "PAYMENT", "RECEIVED", "THANK",
+    "YOU", "FOR", "YOUR", "BUSINESS", "PAGE", "OF", "THE", "AND", "WITH",
+    "QUANTITY", "PRICE", "TAX", "REFERENCE", "SERVICE", "PERIOD"};
+
+constexpr int kGlyphWidth = 5;
+constexpr int kGlyphHeight = 7;
+constexpr int kScale = 4;    // 20x28 pixel glyphs, roughly 12 pt at 300 dpi
+constexpr int kMargin = 40;
+constexpr int kLineChars = 48;
+
+const Glyph* FindGlyph(char c) {
+    for (const Glyph& glyph : kFont) {
+        if (glyph.c == c) {
+            return &glyph;
+        }
+    }
+    return nullptr;  // Space and anything unknown render blank
+}
+
+std::string RenderPage(int page, int lines) {
+    // Deterministic text per page, so runs are reproducible
+    std::mt19937 rng(page + 1);
+    std::vector<std::string> text;
+    for (int line = 0; line < lines; ++line) {
+        std::string row;
+        while (true) {
+            std::string word = kWords[rng() % (sizeof(kWords) / sizeof(kWords[0]))];
+            if (rng() % 4 == 0) {
+                word = std::to_string(rng() % 10000);
+            }
+            if (row.size() + word.size() + 2 > kLineChars) {  // Room for a period
+                break;
+            }
+            row += (row.empty() ? "" : " ") + word;
+        }
+        text.push_back(row + (line % 3 == 2 ? "." : ""));
+    }
+
+    const int cell_w = (kGlyphWidth + 1) * kScale;
+    const int line_h = (kGlyphHeight + 4) * kScale;
+    const int width = 2 * kMargin + kLineChars * cell_w;
+    const int height = 2 * kMargin + lines * line_h;
+
+    std::string header = "P5\n" + std::to_string(width) + " " +
+                         std::to_string(height) + "\n255\n";
+    std::string image = header;
+    image.resize(header.size() + static_cast<size_t>(width) * height, '\xFF');
+    uint8_t* pixels = reinterpret_cast<uint8_t*>(&image[header.size()]);
+
+    for (int line = 0; line < lines; ++line) {
+        for (size_t col = 0; col < text[line].size(); ++col) {
+            const Glyph* glyph = FindGlyph(text[line][col]);
+            if (glyph == nullptr) {
+                continue;
+            }
+            int x0 = kMargin + static_cast<int>(col) * cell_w;
+            int y0 = kMargin + line * line_h;
+            for (int gy = 0; gy < kGlyphHeight; ++gy) {
+                for (int gx = 0; gx < kGlyphWidth; ++gx) {
+                    if (!(glyph->rows[gy] & (0x10 >> gx))) {
+                        continue;
+                    }
+                    for (int dy = 0; dy < kScale; ++dy) {
+                        uint8_t* row = pixels + static_cast<size_t>(y0 + gy * kScale + dy) * width;
+                        std::fill_n(row + x0 + gx * kScale, kScale, 0);
+                    }
+                }
+            }
+        }
+    }
+    return image;
+}
+
+std::vector<CorpusImage> LoadCorpus(const BenchOptions& options) {
+    std::vector<CorpusImage> corpus;
+    if (options.corpus.empty()) {
+        for (int i = 0; i < options.synthetic; ++i) {
+            corpus.push_back({"synthetic_" + std::to_string(i) + ".pgm",
+                              RenderPage(i, options.lines)});
+        }
+        return corpus;
+    }
+
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(options.corpus)) {
+        if (entry.is_regular_file()) {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());  // Stable order across runs
+    for (const auto& path : paths) {
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream data;
+        data << file.rdbuf();
+        corpus.push_back({path.filename().string(), data.str()});
+    }
+    return corpus;
+}
+
+// ----------------------------------------------------------------------------
+// Results
+// ----------------------------------------------------------------------------
+class Recorder {
+public:
+    void Success(double latency_ms, bool cached) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        latencies_.push_back(latency_ms);
+        cached_ += cached ? 1 : 0;
+    }
+
+    void Error(const std::string& kind) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        errors_[kind]++;
+    }
+
+    void Print(const BenchOptions& options, double wall_seconds) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::sort(latencies_.begin(), latencies_.end());
+        auto percentile = [this](double q) {
+            if (latencies_.empty()) {
+                return 0.0;
+            }
+            size_t rank = static_cast<size_t>(q * (latencies_.size() - 1) + 0.5);
+            return latencies_[rank];
+        };
+        double sum = 0;
+        for (double latency : latencies_) {
+            sum += latency;
+        }
+        uint64_t error_count = 0;
+        for (const auto& error : errors_) {
+            error_count += error.second;
+        }
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "{\"label\":\"" << options.label << "\""
+            << ",\"mode\":\"" << options.mode << "\""
+            << ",\"corpus\":\"" << (options.corpus.empty() ? "synthetic" : options.corpus) << "\""
+            << ",\"concurrency\":" << options.concurrency
+            << ",\"rate\":" << options.rate
+            << ",\"requests\":" << options.requests
+            << ",\"completed\":" << latencies_.size()
+            << ",\"cached\":" << cached_
+            << ",\"error_count\":" << error_count
+            << ",\"errors\":{";
+        bool first = true;
+        for (const auto& error : errors_) {
+            out << (first ? "" : ",") << "\"" << error.first << "\":" << error.second;
+            first = false;
+        }
+        out << "},\"wall_s\":" << wall_seconds
+            << ",\"throughput_rps\":" << (wall_seconds > 0 ? latencies_.size() / wall_seconds : 0)
+            << ",\"latency_ms\":{"
+            << "\"mean\":" << (latencies_.empty() ? 0 : sum / latencies_.size())
+            << ",\"p50\":" << percentile(0.50)
+            << ",\"p95\":" << percentile(0.95)
+            << ",\"p99\":" << percentile(0.99)
+            << ",\"p999\":" << percentile(0.999)
+            << ",\"max\":" << (latencies_.empty() ? 0 : latencies_.back())
+            << "}}";
+        std::cout << out.str() << std::endl;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<double> latencies_;
+    uint64_t cached_ = 0;
+    std::map<std::string, uint64_t> errors_;
+};
+
+const char* StatusName(grpc::StatusCode code) {
+    switch (code) {
+    case grpc::StatusCode::CANCELLED: return "CANCELLED";
+    case grpc::StatusCode::DEADLINE_EXCEEDED: return "DEADLINE_EXCEEDED";
+    case grpc::StatusCode::RESOURCE_EXHAUSTED: return "RESOURCE_EXHAUSTED";
+    case grpc::StatusCode::UNAVAILABLE: return "UNAVAILABLE";
+    case grpc::StatusCode::INTERNAL: return "INTERNAL";
+    default: return "OTHER";
+    }
+}
+
+double MillisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// ----------------------------------------------------------------------------
+// Load generation
+// ----------------------------------------------------------------------------
+class LoadGenerator {
+public:
+    LoadGenerator(const BenchOptions& options, std::vector<CorpusImage> corpus)
+        : options_(options), corpus_(std::move(corpus)),
+          stub_(ocrservice::OCRService::NewStub(
+              grpc::CreateChannel(options.target, grpc::InsecureChannelCredentials()))) {}
+
+    // Runs `count` requests; returns wall-clock seconds. Request indices
+    // continue across runs, so warmup and measured requests never share bytes.
+    double Run(int count, Recorder* recorder) {
+        first_ = end_;
+        end_ = first_ + count;
+        next_ = first_;
+        start_ = Clock::now();
+
+        std::vector<std::thread> callers;
+        for (int i = 0; i < options_.concurrency; ++i) {
+            if (options_.mode == "batch") {
+                callers.emplace_back(&LoadGenerator::BatchCaller, this, recorder);
+            } else {
+                callers.emplace_back(&LoadGenerator::ImageCaller, this, recorder);
+            }
+        }
+        for (auto& caller : callers) {
+            caller.join();
+        }
+        return MillisSince(start_) / 1000.0;
+    }
+
+private:
+    // Claims the next request index and, in open loop, waits for its slot.
+    // Returns false once all requests have been claimed.
+    bool Claim(int* index, Clock::time_point* scheduled) {
+        *index = next_.fetch_add(1);
+        if (*index >= end_) {
+            return false;
+        }
+        if (options_.rate > 0) {
+            *scheduled = start_ + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>((*index - first_) / options_.rate));
+            std::this_thread::sleep_until(*scheduled);
+        } else {
+            *scheduled = Clock::now();
+        }
+        return true;
+    }
+
+    ocrservice::ImageRequest MakeRequest(int index) {
+        const CorpusImage& image = corpus_[index % corpus_.size()];
+        ocrservice::ImageRequest request;
+        request.set_image_id(std::to_string(index) + ":" + image.name);
+        request.set_image_data(image.data);
+        if (options_.bust_cache) {
+            // Trailing bytes are ignored by the image decoders but change the
+            // content hash, so the server's result cache never answers
+            std::string salt = "#" + std::to_string(run_salt_) + "-" + std::to_string(index);
+            request.mutable_image_data()->append(salt);
+        }
+        return request;
+    }
+
+    static void Record(const ocrservice::OCRResponse& response, double latency_ms,
+                       Recorder* recorder) {
+        if (response.success()) {
+            recorder->Success(latency_ms, response.cached());
+        } else {
+            recorder->Error("ocr_failed");
+        }
+    }
+
+    void ImageCaller(Recorder* recorder) {
+        int index;
+        Clock::time_point scheduled;
+        while (Claim(&index, &scheduled)) {
+            ocrservice::ImageRequest request = MakeRequest(index);
+            grpc::ClientContext context;
+            context.set_deadline(std::chrono::system_clock::now() +
+                                 std::chrono::milliseconds(options_.deadline_ms));
+
+            // Partial messages (split pages, multi-page documents) precede
+            // the final one; latency is taken at the final message
+            auto reader = stub_->ProcessImage(&context, request);
+            ocrservice::OCRResponse response;
+            ocrservice::OCRResponse final_response;
+            bool got_final = false;
+            while (reader->Read(&response)) {
+                if (!response.is_partial()) {
+                    final_response = response;
+                    got_final = true;
+                }
+            }
+            double latency_ms = MillisSince(scheduled);
+            grpc::Status status = reader->Finish();
+
+            if (!status.ok()) {
+                recorder->Error(StatusName(status.error_code()));
+            } else if (!got_final) {
+                recorder->Error("no_result");
+            } else {
+                Record(final_response, latency_ms, recorder);
+            }
+        }
+    }
+
+    // One stream per caller: a writer (this thread) keeps up to --window
+    // images in flight, and a reader thread matches results by image_id
+    void BatchCaller(Recorder* recorder) {
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() +
+                             std::chrono::milliseconds(options_.deadline_ms) * (end_ - first_));
+        auto stream = stub_->ProcessBatch(&context);
+
+        std::mutex mutex;
+        std::condition_variable window_cv;
+        std::unordered_map<std::string, Clock::time_point> in_flight;
+        bool reader_done = false;
+
+        std::thread reader([&]() {
+            ocrservice::OCRResponse response;
+            while (stream->Read(&response)) {
+                if (response.is_partial()) {
+                    continue;
+                }
+                Clock::time_point scheduled;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto it = in_flight.find(response.image_id());
+                    if (it == in_flight.end()) {
+                        continue;
+                    }
+                    scheduled = it->second;
+                    in_flight.erase(it);
+                }
+                window_cv.notify_one();
+                Record(response, MillisSince(scheduled), recorder);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                reader_done = true;  // Stream broken or finished; stop writing
+            }
+            window_cv.notify_one();
+        });
+
+        int index;
+        Clock::time_point scheduled;
+        while (Claim(&index, &scheduled)) {
+            ocrservice::ImageRequest request = MakeRequest(index);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                window_cv.wait(lock, [&]() {
+                    return reader_done ||
+                           static_cast<int>(in_flight.size()) < options_.window;
+                });
+                in_flight[request.image_id()] = scheduled;
+                if (reader_done) {
+                    break;
+                }
+            }
+            if (!stream->Write(request)) {
+                break;
+            }
+        }
+        stream->WritesDone();
+        reader.join();
+
+        grpc::Status status = stream->Finish();
+        for (size_t i = 0; i < in_flight.size(); ++i) {
+            recorder->Error(status.ok() ? "no_result" : StatusName(status.error_code()));
+        }
+    }
+
+    BenchOptions options_;
+    std::vector<CorpusImage> corpus_;
+    std::unique_ptr<ocrservice::OCRService::Stub> stub_;
+    std::atomic<int> next_{0};
+    int first_ = 0;
+    int end_ = 0;
+    Clock::time_point start_;
+    uint64_t run_salt_ = static_cast<uint64_t>(
+        std::chrono::system_clock::now().time_since_epoch().count());
+};
+
+bool ParseFlag(const std::string& arg, BenchOptions& options) {
+    std::string name = arg.substr(2);
+    std::string value;
+    size_t eq = name.find('=');
+    if (eq != std::string::npos) {
+        value = name.substr(eq + 1);
+        name = name.substr(0, eq);
+    }
+
+    if (name == "target") {
+        options.target = value;
+    } else if (name == "corpus") {
+        options.corpus = value;
+    } else if (name == "synthetic") {
+        options.synthetic = std::stoi(value);
+    } else if (name == "lines") {
+        options.lines = std::stoi(value);
+    } else if (name == "mode") {
+        options.mode = value;
+    } else if (name == "requests") {
+        options.requests = std::stoi(value);
+    } else if (name == "warmup") {
+        options.warmup = std::stoi(value);
+    } else if (name == "concurrency") {
+        options.concurrency = std::stoi(value);
+    } else if (name == "rate") {
+        options.rate = std::stod(value);
+    } else if (name == "window") {
+        options.window = std::stoi(value);
+    } else if (name == "deadline_ms") {
+        options.deadline_ms = std::stoi(value);
+    } else if (name == "bust_cache") {
+        options.bust_cache = value.empty() || value == "1" || value == "true";
+    } else if (name == "label") {
+        options.label = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0 || !ParseFlag(arg, options)) {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (options.mode != "image" && options.mode != "batch") {
+        std::cerr << "--mode must be image or batch" << std::endl;
+        return 1;
+    }
+
+    std::vector<CorpusImage> corpus = LoadCorpus(options);
+    if (corpus.empty()) {
+        std::cerr << "Corpus is empty" << std::endl;
+        return 1;
+    }
+    std::cerr << "Corpus: " << corpus.size() << " images, target " << options.target
+              << std::endl;
+
+    LoadGenerator generator(options, std::move(corpus));
+    if (options.warmup > 0) {
+        Recorder ignored;
+        generator.Run(options.warmup, &ignored);
+    }
+
+    Recorder recorder;
+    double wall_seconds = generator.Run(options.requests, &recorder);
+    recorder.Print(options, wall_seconds);
+    return 0;
+}
@@ -0,0 +1,131 @@
+// ============================================================================
+// BENCHMARK: Peak RSS of the server's request path
+// ============================================================================
+// Replays a burst of in-flight requests through two models of the path from
+// protobuf bytes to the worker:
+//   copy - the original path: handler vector, brace-init copy into the queue
+//          and a copy out of the queue in the worker
+//   view - the current path: move-only tasks holding a view of the request
+// Peak RSS is process-wide, so run each mode in its own process:
+//   ocr_mem_bench copy 32 8
+//   ocr_mem_bench view 32 8
+#include "ocr_service.pb.h"
+#include <sys/resource.h>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Stands in for pixReadMem: touches every byte so nothing is optimized away
+uint64_t Consume(const uint8_t* data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 64) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+double PeakRssMb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;  // ru_maxrss is in KB on Linux
+}
+
+std::vector<std::shared_ptr<ocrservice::ImageRequest>> MakeRequests(size_t bytes, int count) {
+    std::vector<std::shared_ptr<ocrservice::ImageRequest>> requests;
+    for (int i = 0; i < count; ++i) {
+        auto request = std::make_shared<ocrservice::ImageRequest>();
+        request->set_image_id("image_" + std::to_string(i));
+        request->mutable_image_data()->assign(bytes, static_cast<char>(i + 1));
+        requests.push_back(request);
+    }
+    return requests;
+}
+
+uint64_t RunCopyPath(const std::vector<std::shared_ptr<ocrservice::ImageRequest>>& requests) {
+    struct Task {
+        std::string image_id;
+        std::vector<uint8_t> image_data;
+    };
+
+    // Handlers stay blocked (and keep their vector) until the worker is done
+    std::vector<std::vector<uint8_t>> handler_copies;
+    std::queue<Task> queue;
+    for (const auto& request : requests) {
+        std::vector<uint8_t> image_data(request->image_data().begin(),
+                                        request->image_data().end());
+        handler_copies.push_back(image_data);
+        queue.push({request->image_id(), handler_copies.back()});
+    }
+
+    uint64_t checksum = 0;
+    while (!queue.empty()) {
+        Task task = queue.front();
+        queue.pop();
+        checksum += Consume(task.image_data.data(), task.image_data.size());
+    }
+    return checksum;
+}
+
+uint64_t RunViewPath(const std::vector<std::shared_ptr<ocrservice::ImageRequest>>& requests) {
+    struct Task {
+        std::string image_id;
+        std::shared_ptr<const void> owner;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    std::queue<Task> queue;
+    for (const auto& request : requests) {
+        queue.push({request->image_id(), request,
+                    reinterpret_cast<const uint8_t*>(request->image_data().data()),
+                    request->image_data().size()});
+    }
+
+    uint64_t checksum = 0;
+    while (!queue.empty()) {
+        Task task = std::move(queue.front());
+        queue.pop();
+        checksum += Consume(task.data, task.size);
+    }
+    return checksum;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: ocr_mem_bench <copy|view> [image_mb] [in_flight]" << std::endl;
+        return 1;
+    }
+
+    std::string mode = argv[1];
+    size_t image_mb = argc > 2 ? std::stoul(argv[2]) : 32;
+    int in_flight = argc > 3 ? std::stoi(argv[3]) : 8;
+
+    auto requests = MakeRequests(image_mb * 1024 * 1024, in_flight);
+    double baseline_mb = PeakRssMb();
+
+    uint64_t checksum;
+    if (mode == "copy") {
+        checksum = RunCopyPath(requests);
+    } else if (mode == "view") {
+        checksum = RunViewPath(requests);
+    } else {
+        std::cerr << "Unknown mode: " << mode << std::endl;
+        return 1;
+    }
+
+    double peak_mb = PeakRssMb();
+    std::cout << "{\"mode\":\"" << mode << "\",\"image_mb\":" << image_mb
+              << ",\"in_flight\":" << in_flight
+              << ",\"requests_rss_mb\":" << baseline_mb
+              << ",\"peak_rss_mb\":" << peak_mb
+              << ",\"path_overhead_mb\":" << (peak_mb - baseline_mb)
+              << ",\"checksum\":" << checksum << "}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,218 @@
+// ============================================================================
+// BENCHMARK: Pre-Decoded Pixel Input vs. an Encode/Decode Round Trip
+// ============================================================================
+// A producer that already holds a decoded frame can either encode it (PNG,
+// the lossless choice) for the server to decode again, or send the pixels as
+// they are (ImageRequest.raw). For one synthetic scanned page per pixel
+// format this times:
+//   png_encode  - pixWriteMem on the producer
+//   png_decode  - the server's old path: pixReadMem, then pixConvertTo8 and,
+//                 when binarizing, pixThresholdToBinary
+//   raw_scalar  - ConvertRawImage with the scalar row kernels
+//   raw_simd    - ConvertRawImage with the best kernels for this CPU
+// Each path's output is compared with png_decode's, pixel by pixel; Leptonica
+// rounds luminance in floating point, so gray may differ by one level.
+// Prints one JSON object per (format, threshold, path).
+//
+// Usage: ocr_raw_bench [width] [height] [iterations]
+#include "raw_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Dark "glyphs" in rows of text on a slightly noisy off-white page, so the
+// PNG encoder sees something close to a camera capture or scan
+std::vector<uint8_t> MakePage(int width, int height, PixelFormat format) {
+    const int bpp = BytesPerPixel(format);
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * bpp);
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> noise(-3, 3);
+    std::bernoulli_distribution ink_cell(0.6);
+
+    const int line_pitch = 40, glyph_height = 24, cell = 18, glyph_width = 14;
+    std::vector<bool> cells((width / cell + 1) * (height / line_pitch + 1));
+    for (size_t i = 0; i < cells.size(); ++i) {
+        cells[i] = ink_cell(random);
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int line = y / line_pitch;
+            bool ink = y % line_pitch < glyph_height && x % cell < glyph_width &&
+                       cells[line * (width / cell + 1) + x / cell];
+            uint8_t* p = pixels.data() + (static_cast<size_t>(y) * width + x) * bpp;
+            int shade = ink ? 30 : 245;
+            if (format == PixelFormat::kGray8) {
+                p[0] = static_cast<uint8_t>(shade + noise(random));
+                continue;
+            }
+            int r = shade + noise(random), g = shade + noise(random);
+            int b = (ink ? 70 : shade) + noise(random);
+            bool bgr = format == PixelFormat::kBgra32;
+            p[0] = static_cast<uint8_t>(bgr ? b : r);
+            p[1] = static_cast<uint8_t>(g);
+            p[2] = static_cast<uint8_t>(bgr ? r : b);
+            if (bpp == 4) {
+                p[3] = 255;
+            }
+        }
+    }
+    return pixels;
+}
+
+// The frame as the producer's PIX, ready to encode
+PixPtr ToPix(const std::vector<uint8_t>& pixels, const RawImage& image) {
+    const int bpp = BytesPerPixel(image.format);
+    const bool gray = image.format == PixelFormat::kGray8;
+    PixPtr pix(pixCreate(image.width, image.height, gray ? 8 : 32));
+    for (int y = 0; y < image.height; ++y) {
+        l_uint32* line = pixGetData(pix.get()) + static_cast<size_t>(y) * pixGetWpl(pix.get());
+        for (int x = 0; x < image.width; ++x) {
+            const uint8_t* p = pixels.data() + (static_cast<size_t>(y) * image.width + x) * bpp;
+            if (gray) {
+                SET_DATA_BYTE(line, x, p[0]);
+            } else if (image.format == PixelFormat::kBgra32) {
+                composeRGBPixel(p[2], p[1], p[0], line + x);
+            } else {
+                composeRGBPixel(p[0], p[1], p[2], line + x);
+            }
+        }
+    }
+    return pix;
+}
+
+// What the decode stage used to hand on: 8 bpp gray, or 1 bpp if binarizing
+PixPtr DecodeEncoded(const l_uint8* data, size_t size, int threshold) {
+    PixPtr pix(pixReadMem(data, size));
+    if (pix && pixGetDepth(pix.get()) != 8) {
+        pix.reset(pixConvertTo8(pix.get(), 0));
+    }
+    if (pix && threshold > 0) {
+        pix.reset(pixThresholdToBinary(pix.get(), threshold));
+    }
+    return pix;
+}
+
+// Largest per-pixel difference between two PIX of the same size and depth
+int MaxDifference(PIX* a, PIX* b) {
+    int depth = pixGetDepth(a);
+    int max_diff = 0;
+    for (int y = 0; y < pixGetHeight(a); ++y) {
+        l_uint32* la = pixGetData(a) + static_cast<size_t>(y) * pixGetWpl(a);
+        l_uint32* lb = pixGetData(b) + static_cast<size_t>(y) * pixGetWpl(b);
+        for (int x = 0; x < pixGetWidth(a); ++x) {
+            int va = depth == 1 ? GET_DATA_BIT(la, x) : GET_DATA_BYTE(la, x);
+            int vb = depth == 1 ? GET_DATA_BIT(lb, x) : GET_DATA_BYTE(lb, x);
+            max_diff = std::max(max_diff, std::abs(va - vb));
+        }
+    }
+    return max_diff;
+}
+
+const char* FormatName(PixelFormat format) {
+    switch (format) {
+    case PixelFormat::kGray8:
+        return "gray8";
+    case PixelFormat::kRgb24:
+        return "rgb24";
+    case PixelFormat::kRgba32:
+        return "rgba32";
+    case PixelFormat::kBgra32:
+        return "bgra32";
+    case PixelFormat::kNone:
+        break;
+    }
+    return "none";
+}
+
+template <typename Fn>
+double MeanMs(int iterations, Fn&& fn) {
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() /
+           iterations;
+}
+
+void Report(const RawImage& image, const std::string& path, double ms, size_t bytes,
+            int max_diff) {
+    std::cout << "{\"format\":\"" << FormatName(image.format)
+              << "\",\"threshold\":" << image.threshold << ",\"path\":\"" << path
+              << "\",\"ms_per_page\":" << ms << ",\"bytes\":" << bytes;
+    if (max_diff >= 0) {
+        std::cout << ",\"max_diff_vs_png\":" << max_diff;
+    }
+    std::cout << "}" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // A4 at 300 dpi by default
+    int width = argc > 1 ? std::stoi(argv[1]) : 2480;
+    int height = argc > 2 ? std::stoi(argv[2]) : 3508;
+    int iterations = argc > 3 ? std::stoi(argv[3]) : 10;
+    std::cerr << "Best kernels on this CPU: " << PixelKernelsName(PixelKernels::kBest)
+              << std::endl;
+
+    for (PixelFormat format : {PixelFormat::kGray8, PixelFormat::kRgb24,
+                               PixelFormat::kBgra32}) {
+        RawImage image;
+        image.format = format;
+        image.width = width;
+        image.height = height;
+        std::vector<uint8_t> pixels = MakePage(width, height, format);
+        std::string error;
+        if (!ValidateRawImage(&image, pixels.size(), &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+
+        // Encoded once for the decode timings; encode is timed separately
+        PixPtr source = ToPix(pixels, image);
+        l_uint8* png = nullptr;
+        size_t png_size = 0;
+        if (pixWriteMem(&png, &png_size, source.get(), IFF_PNG) != 0) {
+            std::cerr << "PNG encoding failed" << std::endl;
+            return 1;
+        }
+        double encode_ms = MeanMs(iterations, [&]() {
+            l_uint8* data = nullptr;
+            size_t size = 0;
+            pixWriteMem(&data, &size, source.get(), IFF_PNG);
+            lept_free(data);
+        });
+
+        for (int threshold : {0, 128}) {
+            image.threshold = threshold;
+            Report(image, "png_encode", encode_ms, png_size, -1);
+
+            PixPtr reference = DecodeEncoded(png, png_size, threshold);
+            double decode_ms = MeanMs(iterations, [&]() {
+                DecodeEncoded(png, png_size, threshold);
+            });
+            Report(image, "png_decode", decode_ms, png_size, 0);
+
+            for (PixelKernels kernels : {PixelKernels::kScalar, PixelKernels::kBest}) {
+                PixPtr converted = ConvertRawImage(pixels.data(), image, kernels);
+                double raw_ms = MeanMs(iterations, [&]() {
+                    ConvertRawImage(pixels.data(), image, kernels);
+                });
+                Report(image, kernels == PixelKernels::kScalar ? "raw_scalar" : "raw_simd",
+                       raw_ms, pixels.size(), MaxDifference(converted.get(), reference.get()));
+            }
+        }
+        lept_free(png);
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+// ============================================================================
+// BENCHMARK: Task Scheduler Throughput and Latency
+// ============================================================================
+// Compares the original design (one std::queue behind a mutex and a condition
+// variable) with the work-stealing scheduler across worker counts. Producer
+// threads stand in for gRPC handlers; each task spins for a fixed amount of
+// "work". Reports throughput and submit-to-start latency percentiles as one
+// JSON object per (scheduler, workers, fanout) triple.
+//
+// With a fanout, each submitted task also forks that many subtasks from the
+// worker running it, as the server does with the strips of a split page.
+// The work-stealing scheduler puts them on the worker's own deque
+// (SubmitLocal); the mutex queue has only its shared queue.
+//
+// Usage: ocr_sched_bench [tasks] [work_ns] [producers] [max_workers] [fanout]
+#include "task_scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchTask {
+    Clock::time_point submitted;
+    bool forked = false;  // Subtasks do not fork again
+};
+
+// The server's original queue: every producer and worker shares one lock
+class MutexQueue {
+public:
+    explicit MutexQueue(int) : stopped_(false) {}
+
+    void Submit(std::unique_ptr<BenchTask> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+    void SubmitLocal(int, std::unique_ptr<BenchTask> task) {
+        Submit(std::move(task));
+    }
+
+    std::unique_ptr<BenchTask> Next(int) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !queue_.empty() || stopped_; });
+        if (queue_.empty()) {
+            return nullptr;
+        }
+        auto task = std::move(queue_.front());
+        queue_.pop();
+        return task;
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    std::queue<std::unique_ptr<BenchTask>> queue_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopped_;
+};
+
+void Spin(int64_t ns) {
+    auto until = Clock::now() + std::chrono::nanoseconds(ns);
+    while (Clock::now() < until) {
+    }
+}
+
+double Percentile(std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index] / 1000.0;  // microseconds
+}
+
+template <typename Scheduler>
+void RunOnce(const std::string& name, int workers, int tasks, int64_t work_ns, int producers,
+             int fanout) {
+    Scheduler scheduler(workers);
+    std::vector<std::vector<int64_t>> latencies(workers);
+
+    std::vector<std::thread> worker_threads;
+    for (int w = 0; w < workers; ++w) {
+        latencies[w].reserve(tasks * (fanout + 1) / workers + 1);
+        worker_threads.emplace_back([&scheduler, &latencies, w, work_ns, fanout]() {
+            while (auto task = scheduler.Next(w)) {
+                auto waited = Clock::now() - task->submitted;
+                latencies[w].push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count());
+                if (!task->forked) {
+                    for (int i = 0; i < fanout; ++i) {
+                        scheduler.SubmitLocal(
+                            w, std::unique_ptr<BenchTask>(new BenchTask{Clock::now(), true}));
+                    }
+                }
+                Spin(work_ns);
+            }
+        });
+    }
+
+    auto start = Clock::now();
+    std::vector<std::thread> producer_threads;
+    for (int p = 0; p < producers; ++p) {
+        int share = tasks / producers + (p < tasks % producers ? 1 : 0);
+        producer_threads.emplace_back([&scheduler, share]() {
+            for (int i = 0; i < share; ++i) {
+                scheduler.Submit(std::unique_ptr<BenchTask>(new BenchTask{Clock::now()}));
+            }
+        });
+    }
+    for (auto& thread : producer_threads) {
+        thread.join();
+    }
+
+    // Both schedulers drain remaining work before Next() returns nullptr; a
+    // worker that forked subtasks runs them itself if the others have left
+    scheduler.Stop();
+    for (auto& thread : worker_threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<int64_t> all;
+    for (auto& per_worker : latencies) {
+        all.insert(all.end(), per_worker.begin(), per_worker.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    std::cout << "{\"scheduler\":\"" << name << "\",\"workers\":" << workers
+              << ",\"producers\":" << producers << ",\"fanout\":" << fanout
+              << ",\"tasks\":" << all.size()
+              << ",\"work_ns\":" << work_ns
+              << ",\"throughput_per_s\":" << static_cast<int64_t>(all.size() / seconds)
+              << ",\"latency_us\":{\"p50\":" << Percentile(all, 0.50)
+              << ",\"p99\":" << Percentile(all, 0.99)
+              << ",\"p999\":" << Percentile(all, 0.999)
+              << ",\"max\":" << Percentile(all, 1.0) << "}}" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int tasks = argc > 1 ? std::stoi(argv[1]) : 200000;
+    int64_t work_ns = argc > 2 ? std::stoll(argv[2]) : 2000;
+    int producers = argc > 3 ? std::stoi(argv[3]) : 4;
+    int max_workers = argc > 4 ? std::stoi(argv[4])
+                               : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int fanout = argc > 5 ? std::stoi(argv[5]) : 4;
+
+    for (int workers = 1; workers <= max_workers; workers *= 2) {
+        // Flat submissions first, then the same with worker-local fan-out
+        for (int fork = 0; fork <= fanout; fork += std::max(fanout, 1)) {
+            RunOnce<MutexQueue>("mutex_queue", workers, tasks, work_ns, producers, fork);
+            RunOnce<WorkStealingScheduler<BenchTask>>("work_stealing", workers, tasks, work_ns,
+                                                      producers, fork);
+        }
+    }
+    return 0;
+}
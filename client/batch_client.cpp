@@ -0,0 +1,551 @@
+#include "batch_client.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include "content_hash.h"
+
+namespace {
+
+const char* const kImageExtensions[] = {
+    ".png", ".jpg", ".jpeg", ".tif", ".tiff", ".bmp", ".gif", ".webp",
+    ".pnm", ".pbm", ".pgm", ".ppm", ".jp2"};
+
+// Files waiting for a sender, per sender; keeps the walker just ahead
+constexpr int kQueuedPerSender = 4;
+
+constexpr int kProgressInterval = 1000;
+
+// Longest a sender waits on its completion queue before re-checking hedges
+constexpr int kMaxWaitMs = 100;
+
+// Files given a span of the run's trace; later files are sent untraced, so
+// a huge run doesn't hold an unbounded trace in memory
+constexpr uint64_t kMaxTracedFiles = 100000;
+
+constexpr int kGetTraceDeadlineMs = 10000;
+
+const char* RecognitionPathName(ocrservice::RecognitionPath path) {
+    switch (path) {
+    case ocrservice::RECOGNITION_FAST: return "fast";
+    case ocrservice::RECOGNITION_FAST_THEN_FULL: return "fast_then_full";
+    default: return "full";
+    }
+}
+
+std::string JsonEscape(const std::string& value) {
+    std::string out;
+    out.reserve(value.size() + 2);
+    for (unsigned char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        case '\f': out += "\\f"; break;
+        default:
+            if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+    return out;
+}
+
+// Column-wise, like the message: {"words":[...],"word_boxes":[l,t,r,b,...],...}
+std::string LayoutJson(const ocrservice::TextLayout& layout) {
+    std::ostringstream out;
+    auto numbers = [&out](const char* name,
+                          const google::protobuf::RepeatedField<uint32_t>& values) {
+        out << ",\"" << name << "\":[";
+        for (int i = 0; i < values.size(); ++i) {
+            out << (i > 0 ? "," : "") << values.Get(i);
+        }
+        out << "]";
+    };
+    out << "{\"words\":[";
+    for (int i = 0; i < layout.words_size(); ++i) {
+        out << (i > 0 ? ",\"" : "\"") << JsonEscape(layout.words(i)) << "\"";
+    }
+    out << "]";
+    numbers("word_boxes", layout.word_boxes());
+    numbers("word_confidences", layout.word_confidences());
+    numbers("line_word_counts", layout.line_word_counts());
+    numbers("line_boxes", layout.line_boxes());
+    numbers("line_confidences", layout.line_confidences());
+    out << "}";
+    return out.str();
+}
+
+// Reads the "path" value back out of a line this client wrote
+bool ParsePath(const std::string& line, std::string* path) {
+    const std::string prefix = "{\"path\":\"";
+    if (line.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    path->clear();
+    for (size_t i = prefix.size(); i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '"') {
+            return true;
+        }
+        if (c != '\\' || i + 1 >= line.size()) {
+            *path += c;
+            continue;
+        }
+        char next = line[++i];
+        switch (next) {
+        case 'n': *path += '\n'; break;
+        case 'r': *path += '\r'; break;
+        case 't': *path += '\t'; break;
+        case 'f': *path += '\f'; break;
+        case 'u':
+            if (i + 4 < line.size()) {
+                *path += static_cast<char>(std::stoi(line.substr(i + 1, 4), nullptr, 16));
+                i += 4;
+            }
+            break;
+        default: *path += next; break;
+        }
+    }
+    return false;  // Truncated line
+}
+
+bool IsRetryable(grpc::StatusCode code) {
+    return code == grpc::StatusCode::UNAVAILABLE ||
+           code == grpc::StatusCode::RESOURCE_EXHAUSTED;
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error_ = std::strerror(errno);
+        return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        error_ = std::strerror(errno);
+        ::close(fd);
+        return;
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ > 0) {
+        void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            error_ = std::strerror(errno);
+            size_ = 0;
+        } else {
+            data_ = data;
+            ::madvise(data_, size_, MADV_SEQUENTIAL);  // Read once, front to back
+        }
+    }
+    ::close(fd);  // The mapping stays valid after the descriptor is closed
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        ::munmap(data_, size_);
+    }
+}
+
+BatchClient::BatchClient(const BatchOptions& options) : options_(options) {
+    if (options_.in_flight < 1) {
+        options_.in_flight = 1;
+    }
+    // INTERPROCESS COMMUNICATION: One channel (one HTTP/2 connection) per
+    // server, shared by every sender; calls are multiplexed over it
+    pool_ = std::make_unique<EndpointPool>(options_.server_address);
+    routing_.deadline = std::chrono::milliseconds(options_.deadline_ms);
+    routing_.hedge = options_.hedge;
+}
+
+bool BatchClient::IsImageFile(const std::string& path) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    for (const char* known : kImageExtensions) {
+        if (extension == known) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// FAULT TOLERANCE: Resume from the previous run's output. Only successes
+// count as done; a torn last line from a crash is ignored.
+void BatchClient::LoadCheckpoint() {
+    std::ifstream previous(options_.output);
+    std::string line;
+    std::string path;
+    while (std::getline(previous, line)) {
+        if (ParsePath(line, &path) && line.find("\"success\":true") != std::string::npos) {
+            done_.insert(path);
+        }
+    }
+    std::cerr << "Checkpoint: " << done_.size() << " files already done" << std::endl;
+}
+
+int BatchClient::Run() {
+    if (options_.resume) {
+        LoadCheckpoint();
+    }
+
+    std::ios::openmode mode = options_.resume ? std::ios::app : std::ios::trunc;
+    output_.open(options_.output, std::ios::out | mode);
+    if (!output_) {
+        std::cerr << "Cannot open output file " << options_.output << std::endl;
+        return -1;
+    }
+    if (options_.resume) {
+        output_ << '\n';  // Terminates a torn last line; blank lines are skipped on resume
+    }
+
+    if (!options_.trace_file.empty()) {
+        trace_ = TraceContext::NewTrace(true);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // MULTITHREADING: One walker feeding `in_flight` senders
+    std::thread walker(&BatchClient::WalkInputs, this);
+    std::vector<std::thread> senders;
+    for (int i = 0; i < options_.in_flight; ++i) {
+        senders.emplace_back(&BatchClient::SenderThread, this, i);
+    }
+    walker.join();
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    if (trace_.valid()) {
+        WriteTrace();
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    uint64_t processed = succeeded_ + failed_;
+    std::cerr << "Done: " << succeeded_ << " succeeded, " << failed_ << " failed, "
+              << skipped_ << " skipped (checkpoint) in " << seconds << " s";
+    if (seconds > 0) {
+        std::cerr << " (" << processed / seconds << " files/s)";
+    }
+    if (deduplicated_ > 0) {
+        std::cerr << "; " << deduplicated_ << " answered by hash ("
+                  << bytes_not_sent_ / (1024 * 1024) << " MB not sent)";
+    }
+    std::cerr << std::endl;
+    return static_cast<int>(failed_.load());
+}
+
+// Streams paths as the trees are walked, so a huge tree never has to be
+// listed up front before the first request goes out
+void BatchClient::WalkInputs() {
+    const size_t capacity = static_cast<size_t>(options_.in_flight) * kQueuedPerSender;
+
+    auto enqueue = [this, capacity](const std::string& path) {
+        if (done_.count(path) != 0) {
+            skipped_++;
+            return;
+        }
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        queue_cv_.wait(lock, [this, capacity]() { return queue_.size() < capacity; });
+        queue_.push_back(path);
+        queued_++;
+        lock.unlock();
+        queue_cv_.notify_all();
+    };
+
+    for (const std::string& input : options_.inputs) {
+        std::error_code error;
+        if (std::filesystem::is_regular_file(input, error)) {
+            enqueue(input);
+            continue;
+        }
+        auto options = std::filesystem::directory_options::skip_permission_denied;
+        std::filesystem::recursive_directory_iterator it(input, options, error);
+        if (error) {
+            std::cerr << "Cannot read " << input << ": " << error.message() << std::endl;
+            continue;
+        }
+        for (; it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            if (error) {
+                std::cerr << "Walk error under " << input << ": " << error.message() << std::endl;
+                break;
+            }
+            if (it->is_regular_file(error) && IsImageFile(it->path().string())) {
+                enqueue(it->path().string());
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        walk_done_ = true;
+    }
+    queue_cv_.notify_all();
+}
+
+bool BatchClient::NextPath(std::string* path) {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    queue_cv_.wait(lock, [this]() { return !queue_.empty() || walk_done_; });
+    if (queue_.empty()) {
+        return false;
+    }
+    *path = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    queue_cv_.notify_all();  // Room for the walker
+    return true;
+}
+
+void BatchClient::SenderThread(int sender) {
+    // Each sender drives its calls on its own queue
+    grpc::CompletionQueue cq;
+    std::string path;
+    while (NextPath(&path)) {
+        int64_t start_us = WallClockMicros();
+        FileResult result = ProcessFile(path, &cq);
+        if (result.trace.valid()) {
+            RecordSpan(result, sender, start_us);
+        }
+        (result.success ? succeeded_ : failed_)++;
+        if (result.deduplicated) {
+            deduplicated_++;
+            bytes_not_sent_ += result.bytes;
+        }
+        WriteResult(result);
+
+        uint64_t processed = succeeded_ + failed_;
+        if (processed % kProgressInterval == 0) {
+            std::cerr << "Processed " << processed << " files (" << failed_
+                      << " failed, " << queued_ - processed << " queued)" << std::endl;
+        }
+    }
+
+    cq.Shutdown();
+    void* tag;
+    bool ok;
+    while (cq.Next(&tag, &ok)) {
+    }
+}
+
+BatchClient::FileResult BatchClient::ProcessFile(const std::string& path,
+                                                 grpc::CompletionQueue* cq) {
+    FileResult result;
+    result.path = path;
+
+    // The mapping is only read while the request is built, which makes the
+    // one copy of the bytes; no intermediate buffer is filled. Files too big
+    // for one message are streamed from disk in chunks instead.
+    ocrservice::ImageRequest request;
+    std::string upload_path;
+    uint64_t content_hash = 0;
+    {
+        MappedFile file(path);
+        if (!file.ok()) {
+            result.error = "Failed to read file: " + file.error();
+            return result;
+        }
+        result.bytes = file.size();
+        // CACHING: Hashed straight from the mapping, so a file the server
+        // already knows costs one small lookup instead of its upload
+        if (options_.dedupe && file.size() >= kLookupByHashMinBytes) {
+            content_hash = HashContent(file.data(), file.size());
+        }
+        if (file.size() > kChunkedUploadThreshold) {
+            upload_path = path;
+        } else {
+            request.set_image_data(file.data(), file.size());
+        }
+    }
+    request.set_image_id(path);
+    request.set_split_blocks(options_.split_blocks);
+    request.set_include_layout(options_.layout);
+    *request.mutable_engine() = options_.engine;
+    if (trace_.valid() && traced_files_++ < kMaxTracedFiles) {
+        result.trace = trace_.NewSpan();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int attempt = 0;; ++attempt) {
+        // FAULT TOLERANCE: The call fails over to other servers itself and
+        // carries the per-request deadline, so one stuck call can't stall the run
+        RoutedCall call(pool_.get(), cq, request, routing_, upload_path);
+        call.set_content_hash(content_hash);
+        call.set_trace(result.trace);
+        bool done = !call.Start();
+        while (!done) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                call.NextWakeup() - std::chrono::steady_clock::now());
+            wait = std::max(std::chrono::milliseconds(0),
+                            std::min(wait, std::chrono::milliseconds(kMaxWaitMs)));
+            void* tag;
+            bool ok;
+            switch (cq->AsyncNext(&tag, &ok, std::chrono::system_clock::now() + wait)) {
+            case grpc::CompletionQueue::GOT_EVENT:
+                done = call.HandleEvent(tag, ok);
+                break;
+            case grpc::CompletionQueue::TIMEOUT:
+                call.MaybeHedge();
+                break;
+            case grpc::CompletionQueue::SHUTDOWN:
+                done = true;
+                break;
+            }
+        }
+        result.server = call.endpoint();
+
+        if (call.has_response()) {
+            const ocrservice::OCRResponse& response = call.response();
+            result.success = response.success();
+            result.cached = response.cached();
+            result.deduplicated = call.deduplicated();
+            result.pages = response.page_count();
+            result.recognition = response.recognition_path();
+            result.confidence = response.mean_confidence();
+            result.fast_pass_confidence = response.fast_pass_confidence();
+            result.text = response.extracted_text();
+            result.layout = response.layout();
+            result.error = response.error_message();
+            break;
+        }
+        const grpc::Status& status = call.status();
+        // FAULT TOLERANCE: Back off and retry while every server is
+        // overloaded or unreachable; other errors are final
+        if (!IsRetryable(status.error_code()) || attempt >= options_.retries) {
+            result.error = "Connection error: " + status.error_message();
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200 << attempt));
+    }
+    result.latency_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// One line per file; `path` always comes first so the checkpoint reader
+// can find it without a JSON parser
+void BatchClient::WriteResult(const FileResult& result) {
+    std::ostringstream line;
+    line << "{\"path\":\"" << JsonEscape(result.path) << "\""
+         << ",\"success\":" << (result.success ? "true" : "false")
+         << ",\"bytes\":" << result.bytes
+         << ",\"latency_ms\":" << static_cast<int64_t>(result.latency_ms)
+         << ",\"cached\":" << (result.cached ? "true" : "false");
+    if (!result.server.empty()) {
+        line << ",\"server\":\"" << JsonEscape(result.server) << "\"";
+    }
+    if (result.pages > 0) {
+        line << ",\"pages\":" << result.pages;
+    }
+    // Recognition details, for tuning the server's fast-pass threshold;
+    // cached results carry none
+    if (result.success && !result.cached) {
+        line << ",\"recognition\":\"" << RecognitionPathName(result.recognition) << "\""
+             << ",\"confidence\":" << result.confidence;
+        if (result.recognition != ocrservice::RECOGNITION_FULL) {
+            line << ",\"fast_pass_confidence\":" << result.fast_pass_confidence;
+        }
+    }
+    if (result.success) {
+        line << ",\"text\":\"" << JsonEscape(result.text) << "\"";
+        if (options_.layout) {
+            line << ",\"layout\":" << LayoutJson(result.layout);
+        }
+    } else {
+        line << ",\"error\":\"" << JsonEscape(result.error) << "\"";
+    }
+    line << "}\n";
+
+    // SYNCHRONIZATION: Whole lines only, flushed so a crash loses at most
+    // the results still in flight
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    output_ << line.str();
+    output_.flush();
+}
+
+// ============================================================================
+// MONITORING: Client Side of the Run's Trace
+// ============================================================================
+// One row per sender; each file's span carries the span id the servers saw
+// as its parent, so client and server events can be matched up
+void BatchClient::RecordSpan(const FileResult& result, int sender, int64_t start_us) {
+    TraceEvent event;
+    event.name = "file";
+    event.start_us = start_us;
+    event.duration_us = static_cast<int64_t>(result.latency_ms * 1000);
+    event.pid = static_cast<int>(getpid());
+    event.tid = sender + 1;
+    event.AddArg("image", result.path);
+    event.AddArg("trace_id", result.trace.TraceIdHex());
+    event.AddArg("span", result.trace.SpanIdHex());
+    event.AddArg("bytes", static_cast<int64_t>(result.bytes));
+    event.AddArg("server", result.server);
+    event.AddArg("outcome", !result.success ? "failed"
+                            : result.deduplicated ? "deduplicated"
+                            : result.cached ? "cached" : "ok");
+
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    AppendTraceEvent(event, &trace_events_);
+}
+
+// Collects every server's spans for this run's trace and writes them with
+// the client's as one file for Perfetto or chrome://tracing. Both sides use
+// wall-clock timestamps, so they line up as far as the clocks agree.
+void BatchClient::WriteTrace() {
+    std::string events;
+    const int pid = static_cast<int>(getpid());
+    AppendProcessName(pid, "ocr_batch", &events);
+    for (int i = 0; i < options_.in_flight; ++i) {
+        AppendThreadName(pid, i + 1, "sender " + std::to_string(i), &events);
+    }
+    if (!trace_events_.empty()) {
+        events += ",\n" + trace_events_;
+    }
+
+    int server_requests = 0;
+    for (int i = 0; i < pool_->size(); ++i) {
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() +
+                             std::chrono::milliseconds(kGetTraceDeadlineMs));
+        ocrservice::TraceRequest request;
+        request.set_trace_id(trace_.TraceIdHex());
+        request.set_clear(true);
+        ocrservice::TraceResponse response;
+        grpc::Status status = pool_->stub(i)->GetTrace(&context, request, &response);
+        if (!status.ok()) {
+            std::cerr << "No trace from " << pool_->address(i) << ": "
+                      << status.error_message() << std::endl;
+            continue;
+        }
+        if (!response.trace_events().empty()) {
+            events += ",\n" + response.trace_events();
+        }
+        server_requests += response.requests();
+    }
+
+    std::ofstream file(options_.trace_file, std::ios::trunc);
+    file << "{\"traceEvents\":[\n" << events << "\n]}\n";
+    if (!file) {
+        std::cerr << "Cannot write trace file " << options_.trace_file << std::endl;
+        return;
+    }
+    std::cerr << "Trace " << trace_.TraceIdHex() << " written to " << options_.trace_file
+              << " (" << server_requests << " server-side requests)" << std::endl;
+}
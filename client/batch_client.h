@@ -0,0 +1,137 @@
+#ifndef BATCH_CLIENT_H
+#define BATCH_CLIENT_H
+
+#include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "endpoint_pool.h"
+#include "ocr_service.grpc.pb.h"
+#include "trace_context.h"
+
+// Read-only memory mapping of one input file. The pages are shared with the
+// page cache, so the only copy made is into the request message.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return data_ != nullptr || size_ == 0; }
+    const char* data() const { return static_cast<const char*>(data_); }
+    size_t size() const { return size_; }
+    const std::string& error() const { return error_; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    std::string error_;
+};
+
+struct BatchOptions {
+    std::string server_address = "localhost:50051";  // Comma-separated list
+    std::vector<std::string> inputs;  // Files or directory trees
+    std::string output = "ocr_results.jsonl";
+    int in_flight = 16;               // Concurrent requests
+    bool resume = false;              // Skip files already done in `output`
+    int deadline_ms = 60000;
+    int retries = 3;                  // On UNAVAILABLE / RESOURCE_EXHAUSTED
+    bool split_blocks = false;
+    bool hedge = false;               // Duplicate slow calls on a second server
+    bool dedupe = true;               // LookupByHash before sending large files
+    ocrservice::EngineOptions engine; // Language, modes and variables for every file
+    bool layout = false;              // Add word and line boxes to each line
+    std::string trace_file;           // Chrome trace of every file, with the servers' spans
+};
+
+// ============================================================================
+// HEADLESS CLIENT: Bulk Directory OCR
+// ============================================================================
+// A walker thread streams file paths from the input trees into a bounded
+// queue; `in_flight` sender threads share one channel per server and each
+// keep one ProcessImage call outstanding, routed to the least-loaded server
+// with failover (see RoutedCall). Results are appended to the JSONL output as
+// they arrive and flushed line by line, so the output doubles as the
+// checkpoint: with `resume`, files that already have a successful line are
+// skipped and failed ones are retried.
+//
+// With `trace_file`, the run is one trace and every file a span of it. The
+// trace context travels to the servers as gRPC metadata, and at the end
+// their spans for this trace (GetTrace) are merged with the client's into
+// one Chrome trace file.
+class BatchClient {
+public:
+    explicit BatchClient(const BatchOptions& options);
+
+    // Returns the number of files that failed
+    int Run();
+
+private:
+    struct FileResult {
+        std::string path;
+        uint64_t bytes = 0;
+        bool success = false;
+        bool cached = false;
+        bool deduplicated = false;  // Answered by hash; the bytes were never sent
+        int pages = 0;
+        ocrservice::RecognitionPath recognition = ocrservice::RECOGNITION_FULL;
+        int confidence = 0;
+        int fast_pass_confidence = 0;
+        std::string text;
+        std::string error;
+        std::string server;
+        ocrservice::TextLayout layout;
+        double latency_ms = 0;
+        TraceContext trace;  // This file's span, when tracing
+    };
+
+    void LoadCheckpoint();
+    void WalkInputs();
+    bool NextPath(std::string* path);
+    void SenderThread(int sender);
+    FileResult ProcessFile(const std::string& path, grpc::CompletionQueue* cq);
+    void WriteResult(const FileResult& result);
+    void RecordSpan(const FileResult& result, int sender, int64_t start_us);
+    void WriteTrace();
+
+    static bool IsImageFile(const std::string& path);
+
+    BatchOptions options_;
+    std::unique_ptr<EndpointPool> pool_;
+    RoutingOptions routing_;
+
+    // SYNCHRONIZATION: Bounded queue between the walker and the senders
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<std::string> queue_;
+    bool walk_done_ = false;
+
+    std::unordered_set<std::string> done_;  // Checkpoint: already succeeded
+
+    std::mutex output_mutex_;
+    std::ofstream output_;
+
+    // MONITORING: One trace for the run, one span per file
+    TraceContext trace_;
+    std::atomic<uint64_t> traced_files_{0};
+    std::mutex trace_mutex_;
+    std::string trace_events_;
+
+    std::atomic<uint64_t> queued_{0};
+    std::atomic<uint64_t> skipped_{0};
+    std::atomic<uint64_t> succeeded_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> deduplicated_{0};
+    std::atomic<uint64_t> bytes_not_sent_{0};
+};
+
+#endif // BATCH_CLIENT_H
@@ -0,0 +1,83 @@
+#include "batch_client.h"
+#include <iostream>
+#include <string>
+
+// Parses "--name=value" style flags; returns false for unknown flags.
+bool ParseFlag(const std::string& arg, BatchOptions& options) {
+    std::string name = arg.substr(2);
+    std::string value;
+    size_t eq = name.find('=');
+    if (eq != std::string::npos) {
+        value = name.substr(eq + 1);
+        name = name.substr(0, eq);
+    }
+
+    if (name == "server") {
+        options.server_address = value;
+    } else if (name == "output") {
+        options.output = value;
+    } else if (name == "in_flight") {
+        options.in_flight = std::stoi(value);
+    } else if (name == "resume") {
+        options.resume = value.empty() || value == "1" || value == "true";
+    } else if (name == "deadline_ms") {
+        options.deadline_ms = std::stoi(value);
+    } else if (name == "retries") {
+        options.retries = std::stoi(value);
+    } else if (name == "split_blocks") {
+        options.split_blocks = value.empty() || value == "1" || value == "true";
+    } else if (name == "hedge") {
+        options.hedge = value.empty() || value == "1" || value == "true";
+    } else if (name == "dedupe") {
+        options.dedupe = value.empty() || value == "1" || value == "true";
+    } else if (name == "layout") {
+        options.layout = value.empty() || value == "1" || value == "true";
+    } else if (name == "trace") {
+        options.trace_file = value;
+    } else if (name == "lang") {
+        options.engine.set_language(value);
+    } else if (name == "psm") {
+        options.engine.set_page_seg_mode(std::stoi(value));
+    } else if (name == "oem") {
+        options.engine.set_engine_mode(std::stoi(value));
+    } else if (name == "var") {
+        // --var=NAME=VALUE, repeatable
+        size_t split = value.find('=');
+        if (split == std::string::npos || split == 0) {
+            return false;
+        }
+        (*options.engine.mutable_variables())[value.substr(0, split)] = value.substr(split + 1);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BatchOptions options;
+
+    // Usage: ocr_batch [--flag[=value] ...] PATH...
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0) {
+            if (!ParseFlag(arg, options)) {
+                std::cerr << "Unknown flag: " << arg << std::endl;
+                return 2;
+            }
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.inputs.empty()) {
+        std::cerr << "Usage: ocr_batch [--server=HOST:PORT[,HOST:PORT...]] "
+                     "[--output=FILE.jsonl] [--in_flight=N] [--resume] [--deadline_ms=N] "
+                     "[--retries=N] [--split_blocks] [--hedge] [--dedupe=0|1] [--lang=eng+deu] "
+                     "[--psm=N] [--oem=N] [--var=NAME=VALUE ...] [--layout] [--trace=FILE.json] "
+                     "PATH..." << std::endl;
+        return 2;
+    }
+
+    BatchClient client(options);
+    int failed = client.Run();
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,479 @@
+#include "endpoint_pool.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// Below this many samples p95 is noise; don't hedge yet
+constexpr size_t kMinHedgeSamples = 20;
+
+// Never hedge sooner than this, however fast recent calls were
+constexpr int kMinHedgeDelayMs = 20;
+
+constexpr int kStatsDeadlineMs = 500;
+
+// UploadImage chunk size; small enough not to hold up other calls sharing
+// the connection
+constexpr size_t kUploadChunkBytes = 256 * 1024;
+
+}  // namespace
+
+EndpointPool::EndpointPool(const std::string& endpoints, const Options& options)
+    : options_(options) {
+    std::string list = endpoints;
+    std::replace(list.begin(), list.end(), ',', ' ');
+    std::istringstream in(list);
+    std::string address;
+    while (in >> address) {
+        auto endpoint = std::make_unique<Endpoint>();
+        endpoint->address = address;
+        // INTERPROCESS COMMUNICATION: One channel per server for the life of
+        // the pool. Keepalive pings notice a dead connection between batches.
+        grpc::ChannelArguments args;
+        args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, 30000);
+        args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+        endpoint->channel = grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args);
+        endpoint->stub = ocrservice::OCRService::NewStub(endpoint->channel);
+        endpoints_.push_back(std::move(endpoint));
+    }
+    latencies_.reserve(options_.latency_window);
+
+    if (options_.stats_poll_ms > 0 && !endpoints_.empty()) {
+        poller_ = std::thread(&EndpointPool::PollStats, this);
+    }
+}
+
+EndpointPool::~EndpointPool() {
+    {
+        std::lock_guard<std::mutex> lock(poll_mutex_);
+        stopping_ = true;
+    }
+    poll_cv_.notify_all();
+    if (poller_.joinable()) {
+        poller_.join();
+    }
+}
+
+int64_t EndpointPool::NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EndpointPool::Eject(Endpoint& endpoint) {
+    endpoint.ejected_until_ms = NowMs() + options_.eject_ms;
+}
+
+int EndpointPool::Pick(const std::vector<int>& exclude) {
+    int64_t now = NowMs();
+    int count = size();
+    unsigned start = rotation_.fetch_add(1, std::memory_order_relaxed);
+
+    int best = -1;
+    bool best_healthy = false;
+    int best_load = 0;
+    for (int k = 0; k < count; ++k) {
+        int i = static_cast<int>((start + k) % count);
+        if (std::find(exclude.begin(), exclude.end(), i) != exclude.end()) {
+            continue;
+        }
+        const Endpoint& endpoint = *endpoints_[i];
+        bool healthy = endpoint.ejected_until_ms.load() <= now;
+        int load = endpoint.outstanding.load() + endpoint.reported_backlog.load();
+        if (best < 0 || (healthy && !best_healthy) ||
+            (healthy == best_healthy && load < best_load)) {
+            best = i;
+            best_healthy = healthy;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+void EndpointPool::Begin(int endpoint) {
+    endpoints_[endpoint]->outstanding++;
+}
+
+void EndpointPool::End(int endpoint, bool success, bool unavailable, double latency_ms) {
+    endpoints_[endpoint]->outstanding--;
+    if (unavailable) {
+        Eject(*endpoints_[endpoint]);
+    }
+    if (!success || options_.latency_window == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    if (latencies_.size() < options_.latency_window) {
+        latencies_.push_back(latency_ms);
+    } else {
+        latencies_[next_latency_] = latency_ms;
+        next_latency_ = (next_latency_ + 1) % latencies_.size();
+    }
+}
+
+std::chrono::milliseconds EndpointPool::HedgeDelay() const {
+    std::vector<double> samples;
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex_);
+        if (latencies_.size() < kMinHedgeSamples) {
+            return std::chrono::milliseconds::max();
+        }
+        samples = latencies_;
+    }
+    auto p95 = samples.begin() + (samples.size() * 95) / 100;
+    std::nth_element(samples.begin(), p95, samples.end());
+    return std::chrono::milliseconds(
+        std::max(kMinHedgeDelayMs, static_cast<int>(*p95)));
+}
+
+// Refreshes each server's backlog, and doubles as a health check: a server
+// that stops answering is ejected, one that answers again is restored. A
+// server still warming up its engines is passed over until the next poll.
+// Servers without GetStats (UNIMPLEMENTED) are balanced on local load only.
+void EndpointPool::PollStats() {
+    std::unique_lock<std::mutex> lock(poll_mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        for (auto& endpoint : endpoints_) {
+            grpc::ClientContext context;
+            context.set_deadline(std::chrono::system_clock::now() +
+                                 std::chrono::milliseconds(kStatsDeadlineMs));
+            ocrservice::StatsRequest request;
+            ocrservice::StatsResponse stats;
+            grpc::Status status = endpoint->stub->GetStats(&context, request, &stats);
+            if (status.ok()) {
+                endpoint->reported_backlog = stats.queue_depth() + stats.ready_images();
+                endpoint->ejected_until_ms =
+                    stats.warming_up() ? NowMs() + options_.stats_poll_ms : 0;
+            } else if (status.error_code() == grpc::StatusCode::UNAVAILABLE ||
+                       status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
+                Eject(*endpoint);
+            }
+        }
+        lock.lock();
+        poll_cv_.wait_for(lock, std::chrono::milliseconds(options_.stats_poll_ms),
+                          [this]() { return stopping_; });
+    }
+}
+
+// ----------------------------------------------------------------------------
+// RoutedCall
+// ----------------------------------------------------------------------------
+struct RoutedCall::Attempt {
+    // ProcessImage: [lookup ->] start -> read* -> finish
+    // UploadImage:  [lookup ->] start -> write* -> last write -> read* -> finish
+    enum class State { LookingUp, Starting, Uploading, ClosingUpload, Reading, Finishing, Done };
+
+    RoutedCall* owner = nullptr;  // Recovered from the completion-queue tag
+    int endpoint = -1;
+    State state = State::Starting;
+    std::chrono::steady_clock::time_point started;
+    grpc::ClientContext lookup_context;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<ocrservice::OCRResponse>> lookup;
+    bool deduplicated = false;  // Answered by the lookup; nothing was sent
+    grpc::ClientContext context;
+    std::unique_ptr<grpc::ClientAsyncReader<ocrservice::OCRResponse>> reader;
+    std::unique_ptr<grpc::ClientAsyncReaderWriter<ocrservice::ImageChunk,
+                                                  ocrservice::OCRResponse>> stream;
+    std::ifstream file;        // Upload source, re-read by every attempt
+    uint64_t file_size = 0;
+    bool header_sent = false;
+    ocrservice::ImageChunk chunk;
+    std::string read_error;    // Local failure; not the server's fault
+    ocrservice::OCRResponse response;
+    ocrservice::OCRResponse final_response;
+    bool got_final = false;
+    grpc::Status status;
+};
+
+RoutedCall::RoutedCall(EndpointPool* pool, grpc::CompletionQueue* cq,
+                       ocrservice::ImageRequest request, const RoutingOptions& options,
+                       std::string upload_path)
+    : pool_(pool), cq_(cq), request_(std::move(request)), options_(options),
+      upload_path_(std::move(upload_path)),
+      hedge_at_(std::chrono::steady_clock::time_point::max()) {}
+
+RoutedCall::~RoutedCall() = default;
+
+RoutedCall* RoutedCall::OwnerOf(void* tag) {
+    return static_cast<Attempt*>(tag)->owner;
+}
+
+bool RoutedCall::IsRetryable(grpc::StatusCode code) {
+    // Failures that say something about the node, not the image
+    return code == grpc::StatusCode::UNAVAILABLE ||
+           code == grpc::StatusCode::RESOURCE_EXHAUSTED ||
+           code == grpc::StatusCode::ABORTED ||
+           code == grpc::StatusCode::INTERNAL ||
+           code == grpc::StatusCode::UNKNOWN;
+}
+
+// Returns false when the call finished without sending anything (no
+// endpoint); no events will arrive for it in that case
+bool RoutedCall::Start() {
+    deadline_ = std::chrono::system_clock::now() + options_.deadline;
+    if (options_.hedge) {
+        std::chrono::milliseconds delay = pool_->HedgeDelay();
+        if (delay != std::chrono::milliseconds::max()) {
+            hedge_at_ = std::chrono::steady_clock::now() + delay;
+        }
+    }
+    if (!Launch()) {
+        finished_ = true;
+        status_ = grpc::Status(grpc::StatusCode::UNAVAILABLE, "No server endpoint configured");
+        return false;
+    }
+    return true;
+}
+
+bool RoutedCall::Launch() {
+    int endpoint = pool_->Pick(tried_);
+    if (endpoint < 0) {
+        return false;
+    }
+    tried_.push_back(endpoint);
+
+    auto attempt = std::make_unique<Attempt>();
+    attempt->owner = this;
+    attempt->endpoint = endpoint;
+    attempt->started = std::chrono::steady_clock::now();
+
+    pool_->Begin(endpoint);
+    // Lookups only find whole-page text, so layout and split-block requests
+    // (which need boxes or per-strip partials) always send the image
+    if (content_hash_ != 0 && !request_.include_layout() && !request_.split_blocks()) {
+        StartLookup(attempt.get());
+    } else {
+        StartTransfer(attempt.get());
+    }
+    ++active_;
+    attempts_.push_back(std::move(attempt));
+    return true;
+}
+
+// CACHING: Ask the endpoint for a result by hash before sending any bytes
+void RoutedCall::StartLookup(Attempt* attempt) {
+    attempt->state = Attempt::State::LookingUp;
+    attempt->lookup_context.set_deadline(deadline_);
+    ocrservice::HashLookupRequest lookup;
+    lookup.set_image_id(request_.image_id());
+    lookup.set_content_hash(content_hash_);
+    *lookup.mutable_engine() = request_.engine();  // Part of the server's cache key
+    attempt->lookup = pool_->stub(attempt->endpoint)->PrepareAsyncLookupByHash(
+        &attempt->lookup_context, lookup, cq_);
+    attempt->lookup->StartCall();
+    attempt->lookup->Finish(&attempt->response, &attempt->status, attempt);
+}
+
+void RoutedCall::StartTransfer(Attempt* attempt) {
+    attempt->state = Attempt::State::Starting;
+    // FAULT TOLERANCE: Every attempt shares the call's overall deadline
+    attempt->context.set_deadline(deadline_);
+    // MONITORING: Lets the server put its spans on this file's trace
+    if (trace_.valid()) {
+        attempt->context.AddMetadata(kTraceParentKey, trace_.ToTraceParent());
+    }
+
+    auto* stub = pool_->stub(attempt->endpoint);
+    if (upload_path_.empty()) {
+        attempt->reader = stub->PrepareAsyncProcessImage(&attempt->context, request_, cq_);
+        attempt->reader->StartCall(attempt);
+    } else {
+        attempt->file.open(upload_path_, std::ios::binary | std::ios::ate);
+        if (attempt->file) {
+            attempt->file_size = static_cast<uint64_t>(attempt->file.tellg());
+            attempt->file.seekg(0);
+        }
+        attempt->stream = stub->PrepareAsyncUploadImage(&attempt->context, cq_);
+        attempt->stream->StartCall(attempt);
+    }
+}
+
+// ZERO-COPY: One chunk at a time is read from disk into the reused chunk
+// message; the last one half-closes the stream along with its data
+void RoutedCall::SendChunk(Attempt* attempt) {
+    ocrservice::ImageChunk& chunk = attempt->chunk;
+    chunk.Clear();
+    if (!attempt->header_sent) {
+        chunk.set_image_id(request_.image_id());
+        chunk.set_split_blocks(request_.split_blocks());
+        *chunk.mutable_engine() = request_.engine();
+        chunk.set_include_layout(request_.include_layout());
+        if (request_.has_raw()) {
+            *chunk.mutable_raw() = request_.raw();
+        }
+        chunk.set_total_size(attempt->file_size);
+        attempt->header_sent = true;
+    }
+    std::string* data = chunk.mutable_data();
+    data->resize(kUploadChunkBytes);
+    attempt->file.read(&(*data)[0], static_cast<std::streamsize>(data->size()));
+    data->resize(static_cast<size_t>(attempt->file.gcount()));
+
+    if (attempt->file.eof()) {
+        attempt->state = Attempt::State::ClosingUpload;
+        attempt->stream->WriteLast(chunk, grpc::WriteOptions(), attempt);
+    } else if (attempt->file) {
+        attempt->state = Attempt::State::Uploading;
+        attempt->stream->Write(chunk, attempt);
+    } else {
+        // Never send a truncated image: abandon the call instead
+        attempt->read_error = "Failed to read image file " + upload_path_;
+        attempt->context.TryCancel();
+        FinishAttempt(attempt);
+    }
+}
+
+void RoutedCall::ReadNext(Attempt* attempt) {
+    attempt->state = Attempt::State::Reading;
+    if (attempt->stream) {
+        attempt->stream->Read(&attempt->response, attempt);
+    } else {
+        attempt->reader->Read(&attempt->response, attempt);
+    }
+}
+
+void RoutedCall::FinishAttempt(Attempt* attempt) {
+    attempt->state = Attempt::State::Finishing;
+    if (attempt->stream) {
+        attempt->stream->Finish(&attempt->status, attempt);
+    } else {
+        attempt->reader->Finish(&attempt->status, attempt);
+    }
+}
+
+bool RoutedCall::HandleEvent(void* tag, bool ok) {
+    Attempt* attempt = static_cast<Attempt*>(tag);
+
+    switch (attempt->state) {
+    case Attempt::State::LookingUp:
+        if (attempt->status.ok()) {
+            attempt->final_response = attempt->response;
+            attempt->got_final = true;
+            attempt->deduplicated = true;
+            break;
+        }
+        if (attempt->status.error_code() == grpc::StatusCode::NOT_FOUND ||
+            attempt->status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+            // A miss (or a server without LookupByHash): send the image to
+            // the same endpoint after all
+            attempt->status = grpc::Status();
+            StartTransfer(attempt);
+            return false;
+        }
+        break;  // Unreachable, cancelled...: handled like a failed call
+
+    case Attempt::State::Starting:
+        if (!ok) {
+            FinishAttempt(attempt);
+        } else if (attempt->stream) {
+            SendChunk(attempt);
+        } else {
+            ReadNext(attempt);
+        }
+        return false;
+
+    case Attempt::State::Uploading:
+        // A failed write means the server has ended the call; Finish says why
+        if (ok) {
+            SendChunk(attempt);
+        } else {
+            FinishAttempt(attempt);
+        }
+        return false;
+
+    case Attempt::State::ClosingUpload:
+        if (ok) {
+            ReadNext(attempt);
+        } else {
+            FinishAttempt(attempt);
+        }
+        return false;
+
+    case Attempt::State::Reading:
+        // Partial messages (split pages, multi-page documents) precede the
+        // final merged result, which is the one kept
+        if (ok && !attempt->response.is_partial()) {
+            attempt->final_response = attempt->response;
+            attempt->got_final = true;
+        }
+        if (ok) {
+            ReadNext(attempt);
+        } else {
+            FinishAttempt(attempt);
+        }
+        return false;
+
+    case Attempt::State::Finishing:
+        break;
+
+    case Attempt::State::Done:
+        return false;
+    }
+
+    if (!attempt->read_error.empty()) {
+        // Another endpoint would not help
+        attempt->status = grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                       attempt->read_error);
+    }
+    attempt->state = Attempt::State::Done;
+    --active_;
+    bool usable = attempt->status.ok() && attempt->got_final;
+    double latency_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - attempt->started).count();
+    // Lookup hits would drag the hedge delay down, so only transfers count
+    pool_->End(attempt->endpoint, usable && !attempt->deduplicated,
+               attempt->status.error_code() == grpc::StatusCode::UNAVAILABLE, latency_ms);
+
+    if (!finished_) {
+        endpoint_ = pool_->address(attempt->endpoint);
+        if (usable) {
+            // First result wins; the server sheds the cancelled duplicate
+            finished_ = true;
+            has_response_ = true;
+            deduplicated_ = attempt->deduplicated;
+            response_ = std::move(attempt->final_response);
+            status_ = grpc::Status::OK;
+            Cancel();
+        } else {
+            status_ = attempt->status.ok()
+                ? grpc::Status(grpc::StatusCode::UNKNOWN, "Server returned no result")
+                : attempt->status;
+            // FAULT TOLERANCE: Fail over to another node, unless a hedge is
+            // still running and may yet succeed
+            if (active_ == 0) {
+                bool retry = IsRetryable(status_.error_code()) &&
+                             attempts() < options_.max_attempts;
+                if (!retry || !Launch()) {
+                    finished_ = true;
+                }
+            }
+        }
+    }
+    return finished_ && active_ == 0;
+}
+
+// LOAD BALANCING: Tail-latency hedge. At most one duplicate per call, sent
+// to a different endpoint once the first attempt runs past the pool's p95.
+void RoutedCall::MaybeHedge() {
+    if (finished_ || active_ != 1 || attempts() >= options_.max_attempts ||
+        std::chrono::steady_clock::now() < hedge_at_) {
+        return;
+    }
+    hedge_at_ = std::chrono::steady_clock::time_point::max();
+    Launch();
+}
+
+std::chrono::steady_clock::time_point RoutedCall::NextWakeup() const {
+    return finished_ ? std::chrono::steady_clock::time_point::max() : hedge_at_;
+}
+
+void RoutedCall::Cancel() {
+    for (auto& attempt : attempts_) {
+        if (attempt->state == Attempt::State::LookingUp) {
+            attempt->lookup_context.TryCancel();
+        } else if (attempt->state != Attempt::State::Done) {
+            attempt->context.TryCancel();
+        }
+    }
+}
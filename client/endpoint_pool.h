@@ -0,0 +1,176 @@
+#ifndef ENDPOINT_POOL_H
+#define ENDPOINT_POOL_H
+
+#include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ocr_service.grpc.pb.h"
+#include "trace_context.h"
+
+// ============================================================================
+// LOAD BALANCING: Server Endpoint Pool
+// ============================================================================
+// One channel per ocr_server instance. Each endpoint's load is the client's
+// own outstanding calls plus the backlog the server last reported through
+// GetStats (queued + decoded images waiting), so other clients' traffic is
+// seen too. Endpoints that fail with UNAVAILABLE, or whose stats poll fails,
+// are ejected for a while and used only when nothing else is left.
+class EndpointPool {
+public:
+    struct Options {
+        int stats_poll_ms = 1000;    // 0 disables GetStats polling
+        int eject_ms = 5000;
+        size_t latency_window = 512; // Recent call latencies behind HedgeDelay()
+    };
+
+    // `endpoints` is a comma- or space-separated list of host:port
+    explicit EndpointPool(const std::string& endpoints, const Options& options);
+    explicit EndpointPool(const std::string& endpoints) : EndpointPool(endpoints, Options()) {}
+    ~EndpointPool();
+
+    int size() const { return static_cast<int>(endpoints_.size()); }
+    const std::string& address(int endpoint) const { return endpoints_[endpoint]->address; }
+    ocrservice::OCRService::Stub* stub(int endpoint) { return endpoints_[endpoint]->stub.get(); }
+
+    // Least-loaded endpoint not in `exclude`, preferring healthy ones; ties
+    // rotate so idle endpoints share the load. -1 when all are excluded.
+    int Pick(const std::vector<int>& exclude);
+
+    void Begin(int endpoint);
+    // `unavailable` ejects the endpoint; latency is recorded for successes
+    void End(int endpoint, bool success, bool unavailable, double latency_ms);
+
+    // p95 of recent successful calls, or max() until enough samples exist
+    std::chrono::milliseconds HedgeDelay() const;
+
+private:
+    struct Endpoint {
+        std::string address;
+        std::shared_ptr<grpc::Channel> channel;
+        std::unique_ptr<ocrservice::OCRService::Stub> stub;
+        std::atomic<int> outstanding{0};
+        std::atomic<int> reported_backlog{0};
+        std::atomic<int64_t> ejected_until_ms{0};
+    };
+
+    static int64_t NowMs();
+    void Eject(Endpoint& endpoint);
+    void PollStats();
+
+    Options options_;
+    std::vector<std::unique_ptr<Endpoint>> endpoints_;
+    std::atomic<unsigned> rotation_{0};
+
+    mutable std::mutex latency_mutex_;
+    std::vector<double> latencies_;  // Ring buffer
+    size_t next_latency_ = 0;
+
+    std::mutex poll_mutex_;
+    std::condition_variable poll_cv_;
+    bool stopping_ = false;
+    std::thread poller_;
+};
+
+// Smaller images are sent outright: a LookupByHash round trip first would
+// cost more than re-sending them
+constexpr uint64_t kLookupByHashMinBytes = 256 * 1024;
+
+// Images larger than this are streamed from disk through UploadImage instead
+// of being read whole into one ProcessImage message (gRPC's default message
+// limit is 4 MB)
+constexpr uint64_t kChunkedUploadThreshold = 3 * 1024 * 1024;
+
+struct RoutingOptions {
+    std::chrono::milliseconds deadline{60000};
+    int max_attempts = 3;  // Across distinct endpoints, hedges included
+    bool hedge = false;    // Duplicate slow calls on a second endpoint
+};
+
+// ============================================================================
+// LOAD BALANCING: One Routed ProcessImage Call
+// ============================================================================
+// Sends one image to the least-loaded endpoint. Retryable failures move to
+// another endpoint, and with hedging a duplicate goes to a second endpoint
+// once the first has been running longer than the pool's p95. The first final
+// result wins and the other attempt is cancelled (the server then sheds it).
+//
+// With an `upload_path` the image is streamed from that file in chunks
+// through UploadImage, re-read for each attempt, and never held whole in
+// memory; `request` then carries only image_id and split_blocks.
+//
+// With a content hash set, each attempt first asks its endpoint for a cached
+// result through LookupByHash and sends the image only on a miss.
+//
+// Runs on the owner's completion queue: every tag it hands to gRPC belongs to
+// it (see OwnerOf). The owner passes those events to HandleEvent and calls
+// MaybeHedge at least by NextWakeup().
+class RoutedCall {
+public:
+    RoutedCall(EndpointPool* pool, grpc::CompletionQueue* cq,
+               ocrservice::ImageRequest request, const RoutingOptions& options,
+               std::string upload_path = std::string());
+    ~RoutedCall();
+
+    static RoutedCall* OwnerOf(void* tag);
+
+    // HashContent() of the image bytes; call before Start(). 0 sends directly.
+    void set_content_hash(uint64_t hash) { content_hash_ = hash; }
+    // Sent as "traceparent" metadata on every attempt; call before Start()
+    void set_trace(const TraceContext& trace) { trace_ = trace; }
+
+    // Returns false if nothing could be sent; no events will arrive then
+    bool Start();
+    // Returns true once the call is finished and no events remain outstanding
+    bool HandleEvent(void* tag, bool ok);
+    void MaybeHedge();
+    std::chrono::steady_clock::time_point NextWakeup() const;
+    void Cancel();
+
+    bool has_response() const { return has_response_; }
+    const ocrservice::OCRResponse& response() const { return response_; }
+    const grpc::Status& status() const { return status_; }
+    const std::string& endpoint() const { return endpoint_; }
+    int attempts() const { return static_cast<int>(attempts_.size()); }
+    // The result came from LookupByHash; the image was never sent
+    bool deduplicated() const { return deduplicated_; }
+
+private:
+    struct Attempt;
+
+    bool Launch();
+    void StartLookup(Attempt* attempt);
+    void StartTransfer(Attempt* attempt);
+    void SendChunk(Attempt* attempt);
+    void ReadNext(Attempt* attempt);
+    void FinishAttempt(Attempt* attempt);
+    static bool IsRetryable(grpc::StatusCode code);
+
+    EndpointPool* pool_;
+    grpc::CompletionQueue* cq_;
+    ocrservice::ImageRequest request_;
+    RoutingOptions options_;
+    std::string upload_path_;
+    uint64_t content_hash_ = 0;
+    TraceContext trace_;
+    std::chrono::system_clock::time_point deadline_;
+    std::chrono::steady_clock::time_point hedge_at_;
+
+    std::vector<std::unique_ptr<Attempt>> attempts_;
+    std::vector<int> tried_;
+    int active_ = 0;
+    bool finished_ = false;  // A winner was found or no endpoint is left
+
+    bool has_response_ = false;
+    bool deduplicated_ = false;
+    ocrservice::OCRResponse response_;
+    grpc::Status status_;
+    std::string endpoint_;
+};
+
+#endif // ENDPOINT_POOL_H
@@ -1,57 +1,47 @@
 #include "ocr_client.h"
-#include <QPixmap>
 #include <QMessageBox>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLineEdit>
 #include <QFileInfo>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <thread>
+#include "content_hash.h"
 
-ImageResult::ImageResult(const QString& imagePath, QWidget* parent)
-    : QWidget(parent), imagePath_(imagePath) {
+namespace {
 
-    QVBoxLayout* layout = new QVBoxLayout(this);
-    layout->setSpacing(5);
+// Prepared requests kept ready per in-flight slot; bounds prefetched bytes
+constexpr int kPrefetchPerSlot = 1;
 
-    imageLabel_ = new QLabel(this);
-    QPixmap pixmap(imagePath);
-    if (!pixmap.isNull()) {
-        imageLabel_->setPixmap(pixmap.scaled(200, 200, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    }
-    imageLabel_->setAlignment(Qt::AlignCenter);
-    imageLabel_->setStyleSheet("border: 1px solid #ccc; background-color: white;");
-    imageLabel_->setMinimumSize(200, 200);
-
-    resultLabel_ = new QLabel("In progress...", this);
-    resultLabel_->setWordWrap(true);
-    resultLabel_->setAlignment(Qt::AlignTop | Qt::AlignLeft);
-    resultLabel_->setStyleSheet("padding: 5px; background-color: #2b2b2b; color: white; border-radius: 3px;");
-    resultLabel_->setMinimumHeight(60);
-    resultLabel_->setMaximumWidth(200);
-
-    layout->addWidget(imageLabel_);
-    layout->addWidget(resultLabel_);
-    setLayout(layout);
-}
+// How long the completion-queue loop sleeps before checking for new work
+constexpr int kPollIntervalMs = 50;
 
-void ImageResult::setResult(const QString& text) {
-    resultLabel_->setText(text.isEmpty() ? "(no text detected)" : text);
-    resultLabel_->setStyleSheet("padding: 5px; background-color: #2b2b2b; color: white; border-radius: 3px;");
-}
+// Read size when hashing files that are uploaded in chunks
+constexpr size_t kHashBufferBytes = 1 << 20;
 
-void ImageResult::setError(const QString& error) {
-    resultLabel_->setText("Error: " + error);
-    resultLabel_->setStyleSheet("padding: 5px; background-color: #ff4444; color: white; border-radius: 3px;");
-}
+// Concurrent ProcessImage calls per client; enough to keep several server
+// workers busy without flooding its admission queue
+constexpr int kMaxInFlight = 8;
+
+}  // namespace
 
 OCRWorker::OCRWorker(const QString& serverAddress,
-                     const QStringList& imagePaths,
+                     bool hedge,
+                     int maxInFlight,
                      QObject* parent)
     : QThread(parent),
       serverAddress_(serverAddress),
-      imagePaths_(imagePaths),
-      stopped_(false) {
+      maxInFlight_(std::max(1, maxInFlight)),
+      pool_(serverAddress.toStdString()),
+      stopped_(false),
+      completed_(0),
+      total_(0) {
+
+    // FAULT TOLERANCE: 60-second timeout per image, shared by its retries
+    routing_.deadline = std::chrono::seconds(60);
+    routing_.hedge = hedge;
 }
 
 OCRWorker::~OCRWorker() {
@@ -60,73 +50,231 @@ OCRWorker::~OCRWorker() {
 }
 
 void OCRWorker::stop() {
-    stopped_ = true;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopped_ = true;
+    }
+    queueCv_.notify_all();
+}
+
+void OCRWorker::addImages(const QStringList& imagePaths, int firstIndex) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        for (int i = 0; i < imagePaths.size(); ++i) {
+            pending_.push_back({firstIndex + i, imagePaths[i]});
+        }
+        total_ += imagePaths.size();
+    }
+    queueCv_.notify_all();
+}
+
+void OCRWorker::moveUnsentTo(OCRWorker* next) {
+    std::deque<PendingImage> pending;
+    std::deque<PreparedRequest> prepared;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        pending.swap(pending_);
+        prepared.swap(prepared_);
+    }
+    {
+        // Prepared requests were read first, so they go first
+        std::lock_guard<std::mutex> lock(next->queueMutex_);
+        for (PreparedRequest& request : prepared) {
+            next->prepared_.push_back(std::move(request));
+        }
+        for (PendingImage& image : pending) {
+            next->pending_.push_back(std::move(image));
+        }
+        next->total_ += static_cast<int>(prepared.size() + pending.size());
+    }
+    next->queueCv_.notify_all();
+}
+
+// ============================================================================
+// MULTITHREADING: File Prefetch
+// ============================================================================
+// Reads files into ready-to-send requests ahead of the in-flight window, so a
+// slot that frees up is refilled without waiting on the disk.
+void OCRWorker::prefetchLoop() {
+    const size_t capacity = static_cast<size_t>(maxInFlight_) * kPrefetchPerSlot;
+
+    for (;;) {
+        PendingImage image;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueCv_.wait(lock, [this, capacity]() {
+                return stopped_ || (!pending_.empty() && prepared_.size() < capacity);
+            });
+            if (stopped_) {
+                return;
+            }
+            image = pending_.front();
+            pending_.pop_front();
+        }
+
+        // Read the file straight into the request's bytes field: one copy
+        std::ifstream file(image.path.toStdString(), std::ios::binary | std::ios::ate);
+        if (!file) {
+            emit errorOccurred(image.index, "Failed to read image file");
+            reportDone();
+            continue;
+        }
+        PreparedRequest prepared;
+        prepared.index = image.index;
+        // Filename for server logging
+        prepared.request.set_image_id(QFileInfo(image.path).fileName().toStdString());
+
+        uint64_t size = static_cast<uint64_t>(file.tellg());
+        file.seekg(0);
+        if (size > kChunkedUploadThreshold) {
+            // ZERO-COPY: Too big for one message; streamed in chunks when
+            // sent. Only hashed here, a buffer at a time.
+            prepared.uploadPath = image.path.toStdString();
+            ContentHasher hasher;
+            std::vector<char> buffer(kHashBufferBytes);
+            while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+                hasher.Update(buffer.data(), static_cast<size_t>(file.gcount()));
+            }
+            if (file.bad()) {
+                emit errorOccurred(image.index, "Failed to read image file");
+                reportDone();
+                continue;
+            }
+            prepared.contentHash = hasher.Digest();
+        } else {
+            std::string* data = prepared.request.mutable_image_data();
+            data->resize(static_cast<size_t>(size));
+            file.read(&(*data)[0], data->size());
+            if (!file) {
+                emit errorOccurred(image.index, "Failed to read image file");
+                reportDone();
+                continue;
+            }
+            if (size >= kLookupByHashMinBytes) {
+                prepared.contentHash = HashContent(data->data(), data->size());
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            prepared_.push_back(std::move(prepared));
+        }
+    }
+}
+
+bool OCRWorker::takePrepared(PreparedRequest* prepared) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        if (prepared_.empty()) {
+            return false;
+        }
+        *prepared = std::move(prepared_.front());
+        prepared_.pop_front();
+    }
+    queueCv_.notify_all();  // Room for the prefetcher
+    return true;
+}
+
+void OCRWorker::reportDone() {
+    // SYNCHRONIZATION: Update progress bar in UI
+    emit progressUpdated(++completed_, total_);
 }
 
 // ============================================================================
 // MULTITHREADING: Worker Thread Execution
 // ============================================================================
-// This function runs in a separate thread to avoid blocking the UI.
-// It processes all images sequentially and sends them to the server via gRPC.
+// Runs for the life of the worker, off the UI thread. Keeps the in-flight
+// window full from the prefetched requests and drives every call's events
+// from one completion queue.
 void OCRWorker::run() {
-    // INTERPROCESS COMMUNICATION: Create gRPC channel to server
-    channel_ = grpc::CreateChannel(serverAddress_.toStdString(),
-                                   grpc::InsecureChannelCredentials());
-    stub_ = ocrservice::OCRService::NewStub(channel_);
+    std::thread prefetcher(&OCRWorker::prefetchLoop, this);
 
-    int total = imagePaths_.size();
-    for (int i = 0; i < total && !stopped_; ++i) {
-        QString imagePath = imagePaths_[i];
+    while (!stopped_) {
+        PreparedRequest prepared;
+        while (static_cast<int>(inFlight_.size()) < maxInFlight_ && takePrepared(&prepared)) {
+            startCall(std::move(prepared));
+        }
 
-        // Read image file as binary data
-        std::ifstream file(imagePath.toStdString(), std::ios::binary);
-        if (!file) {
-            emit errorOccurred(i, "Failed to read image file");
-            emit progressUpdated(i + 1, total);
-            continue;
+        // Wake up for new work, or when a call is due to be hedged
+        auto wakeup = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(kPollIntervalMs);
+        for (const ActiveCall& active : inFlight_) {
+            wakeup = std::min(wakeup, active.call->NextWakeup());
         }
+        auto deadline = std::chrono::system_clock::now() +
+                        (wakeup - std::chrono::steady_clock::now());
 
-        // Load entire image into memory as byte array
-        std::vector<uint8_t> imageData((std::istreambuf_iterator<char>(file)),
-                                       std::istreambuf_iterator<char>());
-        file.close();
-
-        // INTERPROCESS COMMUNICATION: Prepare gRPC request with Protocol Buffers
-        ocrservice::ImageRequest request;
-        request.set_image_data(imageData.data(), imageData.size());  // Binary image data
-        QFileInfo fileInfo(imagePath);
-        request.set_image_id(fileInfo.fileName().toStdString());     // Filename for server logging
-
-        // FAULT TOLERANCE: Set 60-second timeout to prevent hanging
-        grpc::ClientContext context;
-        context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(60));
-
-        // INTERPROCESS COMMUNICATION: Send request and receive streaming responses
-        std::unique_ptr<grpc::ClientReader<ocrservice::OCRResponse>> reader(
-            stub_->ProcessImage(&context, request));
-
-        // Read streaming responses from server (real-time results)
-        ocrservice::OCRResponse response;
-        bool received = false;
-        while (reader->Read(&response)) {
-            received = true;
-            if (response.success()) {
-                // SYNCHRONIZATION: Emit signal to update UI thread-safely
-                emit resultReady(i, QString::fromStdString(response.extracted_text()));
-            } else {
-                emit errorOccurred(i, QString::fromStdString(response.error_message()));
-            }
+        void* tag;
+        bool ok;
+        if (cq_.AsyncNext(&tag, &ok, deadline) == grpc::CompletionQueue::GOT_EVENT) {
+            handleEvent(tag, ok);
+        }
+        for (const ActiveCall& active : inFlight_) {
+            active.call->MaybeHedge();
         }
+    }
 
-        // FAULT TOLERANCE: Check for connection errors
-        grpc::Status status = reader->Finish();
-        if (!status.ok() && !received) {
-            emit errorOccurred(i, QString::fromStdString("Connection error: " + status.error_message()));
+    // FAULT TOLERANCE: Cancel what is still running and drain its events
+    for (const ActiveCall& active : inFlight_) {
+        active.call->Cancel();
+    }
+    while (!inFlight_.empty()) {
+        void* tag;
+        bool ok;
+        if (!cq_.Next(&tag, &ok)) {
+            break;
         }
+        handleEvent(tag, ok);
+    }
+    cq_.Shutdown();
+    void* tag;
+    bool ok;
+    while (cq_.Next(&tag, &ok)) {
+    }
+
+    prefetcher.join();
+}
+
+void OCRWorker::startCall(PreparedRequest prepared) {
+    // INTERPROCESS COMMUNICATION: The request is serialized when an attempt
+    // starts; the call keeps its own copy for retries and hedges
+    auto call = std::make_unique<RoutedCall>(&pool_, &cq_, std::move(prepared.request), routing_,
+                                             std::move(prepared.uploadPath));
+    // CACHING: Skip the upload when the server already has the result
+    call->set_content_hash(prepared.contentHash);
+    if (!call->Start()) {
+        emit errorOccurred(prepared.index,
+                           QString::fromStdString("Connection error: " + call->status().error_message()));
+        reportDone();
+        return;
+    }
+    inFlight_.push_back({prepared.index, std::move(call)});
+}
 
-        // SYNCHRONIZATION: Update progress bar in UI
-        emit progressUpdated(i + 1, total);
+void OCRWorker::handleEvent(void* tag, bool ok) {
+    RoutedCall* call = RoutedCall::OwnerOf(tag);
+    if (!call->HandleEvent(tag, ok)) {
+        return;
+    }
+    auto it = std::find_if(inFlight_.begin(), inFlight_.end(),
+                           [call](const ActiveCall& active) { return active.call.get() == call; });
+    int index = it->index;
+
+    // SYNCHRONIZATION: Emit signal to update UI thread-safely
+    if (call->has_response()) {
+        const ocrservice::OCRResponse& response = call->response();
+        if (response.success()) {
+            emit resultReady(index, QString::fromStdString(response.extracted_text()));
+        } else {
+            emit errorOccurred(index, QString::fromStdString(response.error_message()));
+        }
+    } else {
+        // FAULT TOLERANCE: Every server tried failed, or none was reachable
+        emit errorOccurred(index,
+                           QString::fromStdString("Connection error: " + call->status().error_message()));
     }
+    reportDone();
+    inFlight_.erase(it);
 }
 
 MainWindow::MainWindow(QWidget* parent)
@@ -156,9 +304,13 @@ void MainWindow::setupUI() {
     mainLayout->setContentsMargins(10, 10, 10, 10);
 
     QHBoxLayout* controlLayout = new QHBoxLayout();
-    QLabel* serverLabel = new QLabel("Server Address:", this);
+    QLabel* serverLabel = new QLabel("Server Address(es):", this);
     serverAddressEdit_ = new QLineEdit("localhost:50051", this);
     serverAddressEdit_->setMinimumWidth(200);
+    serverAddressEdit_->setToolTip("Comma-separated host:port list; images go to the least-loaded server");
+
+    hedgeCheckBox_ = new QCheckBox("Hedge slow requests", this);
+    hedgeCheckBox_->setToolTip("Send a duplicate to a second server when a call runs past the recent p95");
 
     uploadButton_ = new QPushButton("Upload Images", this);
     uploadButton_->setMinimumHeight(35);
@@ -166,6 +318,7 @@ void MainWindow::setupUI() {
 
     controlLayout->addWidget(serverLabel);
     controlLayout->addWidget(serverAddressEdit_);
+    controlLayout->addWidget(hedgeCheckBox_);
     controlLayout->addStretch();
     controlLayout->addWidget(uploadButton_);
 
@@ -177,21 +330,29 @@ void MainWindow::setupUI() {
     progressBar_->setFormat("%v / %m images processed");
     progressBar_->setMinimumHeight(25);
 
-    scrollArea_ = new QScrollArea(this);
-    scrollArea_->setWidgetResizable(true);
-    scrollArea_->setStyleSheet("QScrollArea { border: 1px solid #ccc; background-color: #1e1e1e; }");
-
-    resultsContainer_ = new QWidget();
-    resultsLayout_ = new QGridLayout(resultsContainer_);
-    resultsLayout_->setSpacing(15);
-    resultsLayout_->setAlignment(Qt::AlignTop | Qt::AlignLeft);
-    resultsContainer_->setLayout(resultsLayout_);
-
-    scrollArea_->setWidget(resultsContainer_);
+    // GUI IMPLEMENTATION: Virtualized results grid. Cells are painted by the
+    // delegate from the model, so only visible rows cost anything; uniform
+    // item sizes keep the view from measuring all rows.
+    resultsModel_ = new ResultsModel(this);
+    resultsView_ = new QListView(this);
+    resultsView_->setModel(resultsModel_);
+    resultsView_->setItemDelegate(new ResultDelegate(resultsView_));
+    resultsView_->setViewMode(QListView::IconMode);
+    resultsView_->setFlow(QListView::LeftToRight);
+    resultsView_->setWrapping(true);
+    resultsView_->setResizeMode(QListView::Adjust);
+    resultsView_->setMovement(QListView::Static);
+    resultsView_->setUniformItemSizes(true);
+    resultsView_->setLayoutMode(QListView::Batched);
+    resultsView_->setBatchSize(500);
+    resultsView_->setSpacing(8);
+    resultsView_->setSelectionMode(QAbstractItemView::NoSelection);
+    resultsView_->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    resultsView_->setStyleSheet("QListView { border: 1px solid #ccc; background-color: #1e1e1e; }");
 
     mainLayout->addLayout(controlLayout);
     mainLayout->addWidget(progressBar_);
-    mainLayout->addWidget(scrollArea_);
+    mainLayout->addWidget(resultsView_);
 
     setCentralWidget(centralWidget);
 
@@ -199,11 +360,7 @@ void MainWindow::setupUI() {
 }
 
 void MainWindow::clearResults() {
-    for (auto* result : imageResults_) {
-        resultsLayout_->removeWidget(result);
-        delete result;
-    }
-    imageResults_.clear();
+    resultsModel_->clear();
 }
 
 // ============================================================================
@@ -242,33 +399,39 @@ void MainWindow::onUploadClicked() {
     progressBar_->setMaximum(totalImages_);
     progressBar_->setValue(completedImages_);
 
-    // GUI IMPLEMENTATION: Create result widgets in 4-column grid layout
-    int startIndex = imageResults_.size();
-    for (int i = 0; i < filePaths.size(); ++i) {
-        ImageResult* result = new ImageResult(filePaths[i], resultsContainer_);
-        int row = (startIndex + i) / 4;  // Calculate grid row
-        int col = (startIndex + i) % 4;  // Calculate grid column
-        resultsLayout_->addWidget(result, row, col);
-        imageResults_.push_back(result);
-    }
-
-    // MULTITHREADING: Stop previous worker if exists
-    if (worker_) {
+    // GUI IMPLEMENTATION: One model row per image; nothing is decoded here
+    int startIndex = resultsModel_->addImages(filePaths);
+
+    // MULTITHREADING: Reuse the running worker (and its channels) unless the
+    // server list or hedging changed; new images join its pending queue.
+    // A replaced worker cancels its in-flight calls (reported as errors) and
+    // hands the images it never sent to its successor.
+    QString serverAddress = serverAddressEdit_->text();
+    bool hedge = hedgeCheckBox_->isChecked();
+    OCRWorker* previous = nullptr;
+    if (worker_ && (worker_->serverAddress() != serverAddress || worker_->hedge() != hedge)) {
         worker_->stop();
         worker_->wait();
-        delete worker_;
+        previous = worker_;
+        worker_ = nullptr;
     }
 
-    // MULTITHREADING: Create and start new worker thread
-    worker_ = new OCRWorker(serverAddressEdit_->text(), filePaths, this);
-    worker_->setProperty("startIndex", startIndex);
+    if (!worker_) {
+        worker_ = new OCRWorker(serverAddress, hedge, kMaxInFlight, this);
 
-    // SYNCHRONIZATION: Connect signals from worker thread to UI slots
-    connect(worker_, &OCRWorker::resultReady, this, &MainWindow::onResultReady);
-    connect(worker_, &OCRWorker::errorOccurred, this, &MainWindow::onErrorOccurred);
-    connect(worker_, &OCRWorker::progressUpdated, this, &MainWindow::onProgressUpdated);
+        // SYNCHRONIZATION: Connect signals from worker thread to UI slots
+        connect(worker_, &OCRWorker::resultReady, this, &MainWindow::onResultReady);
+        connect(worker_, &OCRWorker::errorOccurred, this, &MainWindow::onErrorOccurred);
+        connect(worker_, &OCRWorker::progressUpdated, this, &MainWindow::onProgressUpdated);
 
-    worker_->start();  // Start background thread
+        if (previous) {
+            previous->moveUnsentTo(worker_);
+            delete previous;
+        }
+        worker_->start();  // Start background thread
+    }
+
+    worker_->addImages(filePaths, startIndex);
 }
 
 // ============================================================================
@@ -280,21 +443,15 @@ void MainWindow::onUploadClicked() {
 void MainWindow::onResultReady(int index, const QString& text) {
     // SYNCHRONIZATION: Lock mutex before accessing shared data
     QMutexLocker locker(&mutex_);
-    int actualIndex = worker_->property("startIndex").toInt() + index;
-    if (actualIndex >= 0 && actualIndex < imageResults_.size()) {
-        // Update the result widget with OCR text (runs in main/UI thread)
-        imageResults_[actualIndex]->setResult(text);
-    }
+    // Update the model row with OCR text (runs in main/UI thread)
+    resultsModel_->setResult(index, text);
 }
 
 void MainWindow::onErrorOccurred(int index, const QString& error) {
     // SYNCHRONIZATION: Lock mutex before accessing shared data
     QMutexLocker locker(&mutex_);
-    int actualIndex = worker_->property("startIndex").toInt() + index;
-    if (actualIndex >= 0 && actualIndex < imageResults_.size()) {
-        // Update the result widget with error message (runs in main/UI thread)
-        imageResults_[actualIndex]->setError(error);
-    }
+    // Update the model row with the error message (runs in main/UI thread)
+    resultsModel_->setError(index, error);
 }
 
 void MainWindow::onProgressUpdated(int current, int total) {
@@ -6,52 +6,101 @@
 #include <QProgressBar>
 #include <QPushButton>
 #include <QVBoxLayout>
-#include <QScrollArea>
-#include <QGridLayout>
+#include <QListView>
 #include <QFileDialog>
 #include <QThread>
 #include <QMutex>
 #include <QLineEdit>
+#include <QCheckBox>
 #include <grpcpp/grpcpp.h>
 #include <memory>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <vector>
+#include "endpoint_pool.h"
 #include "ocr_service.grpc.pb.h"
+#include "results_view.h"
 
-class ImageResult : public QWidget {
-    Q_OBJECT
-public:
-    explicit ImageResult(const QString& imagePath, QWidget* parent = nullptr);
-    void setResult(const QString& text);
-    void setError(const QString& error);
-
-private:
-    QLabel* imageLabel_;
-    QLabel* resultLabel_;
-    QString imagePath_;
-};
-
+// ============================================================================
+// MULTITHREADING: Long-Lived OCR Worker
+// ============================================================================
+// One worker per server list, kept for the life of the window. It owns a
+// persistent channel per server and keeps up to `maxInFlight` asynchronous
+// ProcessImage calls outstanding on a completion queue, each routed to the
+// least-loaded server (see RoutedCall), so a single client keeps several
+// servers busy. A prefetch thread reads files ahead of the sends. Images
+// added while a batch is running join the pending queue.
 class OCRWorker : public QThread {
     Q_OBJECT
 public:
+    // `serverAddress` may list several comma-separated servers
     OCRWorker(const QString& serverAddress,
-              const QStringList& imagePaths,
+              bool hedge,
+              int maxInFlight = 8,
               QObject* parent = nullptr);
     ~OCRWorker();
     void run() override;
     void stop();
 
+    // Thread-safe. `firstIndex` is the result index of imagePaths[0]; signals
+    // report indices in the same numbering.
+    void addImages(const QStringList& imagePaths, int firstIndex);
+    // For a worker that has been stopped and waited for: hands every image
+    // it never sent, prefetched or not, to `next` under the same indices
+    void moveUnsentTo(OCRWorker* next);
+    QString serverAddress() const { return serverAddress_; }
+    bool hedge() const { return routing_.hedge; }
+
 signals:
     void resultReady(int index, const QString& text);
     void errorOccurred(int index, const QString& error);
     void progressUpdated(int current, int total);
 
 private:
+    struct PendingImage {
+        int index;
+        QString path;
+    };
+
+    // A file read into its request, waiting for an in-flight slot. Large
+    // files are not read here: they stream from `uploadPath` when sent.
+    struct PreparedRequest {
+        int index;
+        ocrservice::ImageRequest request;
+        std::string uploadPath;
+        uint64_t contentHash = 0;  // For LookupByHash; 0 sends the image directly
+    };
+
+    struct ActiveCall {
+        int index;
+        std::unique_ptr<RoutedCall> call;
+    };
+
+    void prefetchLoop();
+    bool takePrepared(PreparedRequest* prepared);
+    void startCall(PreparedRequest prepared);
+    void handleEvent(void* tag, bool ok);
+    void reportDone();
+
     QString serverAddress_;
-    QStringList imagePaths_;
+    int maxInFlight_;
+    RoutingOptions routing_;
+    EndpointPool pool_;
+    grpc::CompletionQueue cq_;
+
+    // SYNCHRONIZATION: Guards the pending and prepared queues
+    std::mutex queueMutex_;
+    std::condition_variable queueCv_;
+    std::deque<PendingImage> pending_;
+    std::deque<PreparedRequest> prepared_;
     std::atomic<bool> stopped_;
-    std::shared_ptr<grpc::Channel> channel_;
-    std::unique_ptr<ocrservice::OCRService::Stub> stub_;
+
+    // Owned by the run() thread
+    std::vector<ActiveCall> inFlight_;
+    std::atomic<int> completed_;
+    std::atomic<int> total_;
 };
 
 class MainWindow : public QMainWindow {
@@ -73,12 +122,11 @@ private:
 
     QPushButton* uploadButton_;
     QProgressBar* progressBar_;
-    QScrollArea* scrollArea_;
-    QWidget* resultsContainer_;
-    QGridLayout* resultsLayout_;
+    QListView* resultsView_;
+    ResultsModel* resultsModel_;
     QLineEdit* serverAddressEdit_;
+    QCheckBox* hedgeCheckBox_;
 
-    std::vector<ImageResult*> imageResults_;
     OCRWorker* worker_;
     int totalImages_;
     int completedImages_;
@@ -0,0 +1,259 @@
+#include "results_view.h"
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+
+// Requests beyond this many are dropped oldest first (see ThumbnailLoader)
+constexpr size_t kMaxQueuedRequests = 256;
+
+// Decoded thumbnails kept in memory, in KB of pixels
+constexpr int kThumbnailCacheKb = 64 * 1024;
+
+// Characters of OCR text painted in a cell; the tooltip has all of it
+constexpr int kMaxPreviewChars = 600;
+
+// Cell geometry around the thumbnail, in pixels
+constexpr int kCellMargin = 5;
+constexpr int kTextHeight = 80;
+constexpr int kTextSpacing = 5;
+
+// Reads at most `bound` pixels. Decoders that support it (JPEG) scale while
+// decoding; for the rest the full image is read once and scaled here, off
+// the UI thread either way.
+QImage DecodeThumbnail(const QString& path, const QSize& bound) {
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    QSize full = reader.size();
+    if (full.isValid() && (full.width() > bound.width() || full.height() > bound.height())) {
+        reader.setScaledSize(full.scaled(bound, Qt::KeepAspectRatio));
+    }
+    QImage image = reader.read();
+    if (!image.isNull() && (image.width() > bound.width() || image.height() > bound.height())) {
+        image = image.scaled(bound, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+}  // namespace
+
+class ThumbnailLoader::DrainTask : public QRunnable {
+public:
+    explicit DrainTask(ThumbnailLoader* loader) : loader_(loader) {}
+    void run() override { loader_->drain(); }
+
+private:
+    ThumbnailLoader* loader_;
+};
+
+ThumbnailLoader::ThumbnailLoader(const QSize& size, QObject* parent)
+    : QObject(parent), size_(size) {
+    // Half the cores; the rest stay free for the UI and the OCR prefetch
+    pool_.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+}
+
+ThumbnailLoader::~ThumbnailLoader() {
+    cancelAll();
+    pool_.waitForDone();
+}
+
+void ThumbnailLoader::request(int row, const QString& path) {
+    QMutexLocker locker(&mutex_);
+    if (queued_.contains(row)) {
+        return;
+    }
+    requests_.push_back(Request{row, path});
+    queued_.insert(row);
+    if (requests_.size() > kMaxQueuedRequests) {
+        queued_.remove(requests_.front().row);
+        requests_.pop_front();
+    }
+    if (draining_ < pool_.maxThreadCount()) {
+        ++draining_;
+        pool_.start(new DrainTask(this));
+    }
+}
+
+void ThumbnailLoader::cancelAll() {
+    QMutexLocker locker(&mutex_);
+    requests_.clear();
+    queued_.clear();
+}
+
+// Pool thread: decodes newest requests first until none are left
+void ThumbnailLoader::drain() {
+    for (;;) {
+        Request next;
+        {
+            QMutexLocker locker(&mutex_);
+            if (requests_.empty()) {
+                --draining_;
+                return;
+            }
+            next = requests_.back();
+            requests_.pop_back();
+        }
+
+        QImage image = DecodeThumbnail(next.path, size_);
+        {
+            QMutexLocker locker(&mutex_);
+            queued_.remove(next.row);
+        }
+        emit loaded(next.row, next.path, image);
+    }
+}
+
+ResultsModel::ResultsModel(QObject* parent)
+    : QAbstractListModel(parent),
+      loader_(new ThumbnailLoader(QSize(kThumbnailSize, kThumbnailSize), this)),
+      thumbnails_(kThumbnailCacheKb) {
+    // SYNCHRONIZATION: Queued, so thumbnails reach the cache on the UI thread
+    connect(loader_, &ThumbnailLoader::loaded, this, &ResultsModel::onThumbnailLoaded,
+            Qt::QueuedConnection);
+}
+
+ResultsModel::~ResultsModel() {
+    delete loader_;  // Waits for running decodes while the model is still whole
+}
+
+int ResultsModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(items_.size());
+}
+
+QVariant ResultsModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    const Item& item = items_[index.row()];
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return QFileInfo(item.path).fileName();
+    case Qt::ToolTipRole:
+        return item.text.isEmpty() ? item.path : item.path + "\n\n" + item.text;
+    case Qt::DecorationRole:
+        // Only rows being painted get here, so only they are decoded
+        if (QPixmap* pixmap = thumbnails_.object(index.row())) {
+            return QVariant::fromValue(*pixmap);
+        }
+        loader_->request(index.row(), item.path);
+        return QVariant();
+    case TextRole:
+        return item.text;
+    case StateRole:
+        return item.state;
+    default:
+        return QVariant();
+    }
+}
+
+int ResultsModel::addImages(const QStringList& paths) {
+    int first = rowCount();
+    if (paths.isEmpty()) {
+        return first;
+    }
+    beginInsertRows(QModelIndex(), first, first + paths.size() - 1);
+    items_.reserve(items_.size() + paths.size());
+    for (const QString& path : paths) {
+        Item item;
+        item.path = path;
+        items_.push_back(std::move(item));
+    }
+    endInsertRows();
+    return first;
+}
+
+void ResultsModel::setResult(int row, const QString& text) {
+    if (row < 0 || row >= rowCount()) {
+        return;
+    }
+    items_[row].text = text;
+    items_[row].state = Done;
+    QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, {TextRole, StateRole, Qt::ToolTipRole});
+}
+
+void ResultsModel::setError(int row, const QString& error) {
+    if (row < 0 || row >= rowCount()) {
+        return;
+    }
+    items_[row].text = error;
+    items_[row].state = Failed;
+    QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, {TextRole, StateRole, Qt::ToolTipRole});
+}
+
+void ResultsModel::clear() {
+    beginResetModel();
+    loader_->cancelAll();
+    items_.clear();
+    thumbnails_.clear();
+    endResetModel();
+}
+
+void ResultsModel::onThumbnailLoaded(int row, const QString& path, const QImage& image) {
+    // Decodes still running when the results were cleared arrive late
+    if (row < 0 || row >= rowCount() || items_[row].path != path) {
+        return;
+    }
+    // A file without a preview caches a null pixmap, so it isn't retried
+    auto* pixmap = new QPixmap(QPixmap::fromImage(image));
+    int cost = std::max(1, pixmap->width() * pixmap->height() * 4 / 1024);
+    thumbnails_.insert(row, pixmap, cost);
+    QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, {Qt::DecorationRole});
+}
+
+void ResultDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
+                           const QModelIndex& index) const {
+    const int size = ResultsModel::kThumbnailSize;
+    QRect cell = option.rect.adjusted(kCellMargin, kCellMargin, -kCellMargin, -kCellMargin);
+    QRect imageRect(cell.left(), cell.top(), size, size);
+    QRect textRect(cell.left(), imageRect.bottom() + 1 + kTextSpacing, size, kTextHeight);
+
+    painter->save();
+    painter->fillRect(imageRect, Qt::white);
+    painter->setPen(QColor("#cccccc"));
+    painter->drawRect(imageRect.adjusted(0, 0, -1, -1));
+
+    QPixmap pixmap = index.data(Qt::DecorationRole).value<QPixmap>();
+    if (!pixmap.isNull()) {
+        QRect target(QPoint(0, 0), pixmap.size());
+        target.moveCenter(imageRect.center());
+        painter->drawPixmap(target, pixmap);
+    } else {
+        painter->setPen(Qt::gray);
+        painter->drawText(imageRect.adjusted(5, 5, -5, -5), Qt::AlignCenter | Qt::TextWrapAnywhere,
+                          index.data(Qt::DisplayRole).toString());
+    }
+
+    auto state = static_cast<ResultsModel::State>(index.data(ResultsModel::StateRole).toInt());
+    QString text = index.data(ResultsModel::TextRole).toString().left(kMaxPreviewChars);
+    if (state == ResultsModel::Pending) {
+        text = "In progress...";
+    } else if (state == ResultsModel::Failed) {
+        text = "Error: " + text;
+    } else if (text.isEmpty()) {
+        text = "(no text detected)";
+    }
+
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(state == ResultsModel::Failed ? QColor("#ff4444") : QColor("#2b2b2b"));
+    painter->drawRoundedRect(textRect, 3, 3);
+    painter->setClipRect(textRect);
+    painter->setPen(Qt::white);
+    painter->drawText(textRect.adjusted(5, 5, -5, -5),
+                      Qt::AlignTop | Qt::AlignLeft | Qt::TextWordWrap, text);
+    painter->restore();
+}
+
+QSize ResultDelegate::sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const {
+    return QSize(ResultsModel::kThumbnailSize + 2 * kCellMargin,
+                 ResultsModel::kThumbnailSize + kTextSpacing + kTextHeight + 2 * kCellMargin);
+}
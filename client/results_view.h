@@ -0,0 +1,120 @@
+#ifndef RESULTS_VIEW_H
+#define RESULTS_VIEW_H
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QPixmap>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QStyledItemDelegate>
+#include <QThreadPool>
+#include <deque>
+#include <vector>
+
+// ============================================================================
+// MULTITHREADING: Background Thumbnail Decoding
+// ============================================================================
+// Decodes thumbnails on its own thread pool. QImageReader::setScaledSize
+// lets decoders such as JPEG's produce the small image directly, so a 20 MP
+// scan never exists at full size in memory. Requests go on a bounded stack
+// and the newest is decoded first: after a fast scroll, the rows now on
+// screen come first and the oldest requests (rows long scrolled past) are
+// dropped. A dropped row is requested again if it is painted again.
+class ThumbnailLoader : public QObject {
+    Q_OBJECT
+public:
+    explicit ThumbnailLoader(const QSize& size, QObject* parent = nullptr);
+    ~ThumbnailLoader();
+
+    // UI thread. Duplicate requests for a queued row are ignored.
+    void request(int row, const QString& path);
+    // UI thread. Forgets queued requests; decodes already running finish.
+    void cancelAll();
+
+signals:
+    // Emitted from a pool thread; a null image means the file has no preview
+    void loaded(int row, const QString& path, const QImage& image);
+
+private:
+    class DrainTask;
+
+    struct Request {
+        int row = 0;
+        QString path;
+    };
+
+    void drain();
+
+    QSize size_;
+    QThreadPool pool_;
+
+    // SYNCHRONIZATION: Guards the request stack and the drain count
+    QMutex mutex_;
+    std::deque<Request> requests_;  // Newest at the back
+    QSet<int> queued_;
+    int draining_ = 0;              // Pool tasks currently draining
+};
+
+// ============================================================================
+// GUI IMPLEMENTATION: Results Model
+// ============================================================================
+// One row per submitted image, holding only its path and OCR state.
+// Thumbnails are decoded when a view first asks for a row's decoration,
+// which a QListView with uniform item sizes only does for visible rows.
+// They are kept in a QCache bounded by pixel memory, so 10k+ images cost
+// the few megabytes of what was recently on screen.
+class ResultsModel : public QAbstractListModel {
+    Q_OBJECT
+public:
+    enum Role {
+        TextRole = Qt::UserRole + 1,  // OCR text or error message
+        StateRole,                    // State
+    };
+    enum State { Pending, Done, Failed };
+
+    static constexpr int kThumbnailSize = 200;
+
+    explicit ResultsModel(QObject* parent = nullptr);
+    ~ResultsModel();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role) const override;
+
+    // Returns the row of the first new image
+    int addImages(const QStringList& paths);
+    void setResult(int row, const QString& text);
+    void setError(int row, const QString& error);
+    void clear();
+
+private slots:
+    void onThumbnailLoaded(int row, const QString& path, const QImage& image);
+
+private:
+    struct Item {
+        QString path;
+        QString text;
+        State state = Pending;
+    };
+
+    std::vector<Item> items_;
+    ThumbnailLoader* loader_;
+    mutable QCache<int, QPixmap> thumbnails_;  // Cost in KB
+};
+
+// Paints one result cell: the thumbnail (or a placeholder) above the OCR
+// text, red on error. No widget exists per cell.
+class ResultDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option,
+               const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+};
+
+#endif // RESULTS_VIEW_H
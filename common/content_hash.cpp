@@ -0,0 +1,156 @@
+#include "content_hash.h"
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t Read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = Rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t value) {
+    acc ^= Round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+inline void InitLanes(uint64_t* v, uint64_t seed) {
+    v[0] = seed + kPrime1 + kPrime2;
+    v[1] = seed + kPrime2;
+    v[2] = seed;
+    v[3] = seed - kPrime1;
+}
+
+inline void ConsumeStripe(uint64_t* v, const uint8_t* p) {
+    v[0] = Round(v[0], Read64(p));
+    v[1] = Round(v[1], Read64(p + 8));
+    v[2] = Round(v[2], Read64(p + 16));
+    v[3] = Round(v[3], Read64(p + 24));
+}
+
+inline uint64_t MergeLanes(const uint64_t* v) {
+    uint64_t h = Rotl(v[0], 1) + Rotl(v[1], 7) + Rotl(v[2], 12) + Rotl(v[3], 18);
+    h = MergeRound(h, v[0]);
+    h = MergeRound(h, v[1]);
+    h = MergeRound(h, v[2]);
+    h = MergeRound(h, v[3]);
+    return h;
+}
+
+// Mixes in the last (< 32) bytes and avalanches
+uint64_t Finalize(uint64_t h, const uint8_t* p, const uint8_t* end) {
+    for (; p + 8 <= end; p += 8) {
+        h ^= Round(0, Read64(p));
+        h = Rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(Read32(p)) * kPrime1;
+        h = Rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (*p) * kPrime5;
+        h = Rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+}  // namespace
+
+// Four independent lanes consume 32 bytes per iteration, so large scans hash
+// at memory bandwidth rather than byte-at-a-time speed.
+uint64_t HashContent(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v[4];
+        InitLanes(v, seed);
+        const uint8_t* limit = end - 32;
+        do {
+            ConsumeStripe(v, p);
+            p += 32;
+        } while (p <= limit);
+        h = MergeLanes(v);
+    } else {
+        h = seed + kPrime5;
+    }
+
+    h += static_cast<uint64_t>(size);
+    return Finalize(h, p, end);
+}
+
+uint64_t HashCombine(uint64_t a, uint64_t b) {
+    uint64_t pair[2] = {a, b};
+    return HashContent(pair, sizeof(pair));
+}
+
+ContentHasher::ContentHasher(uint64_t seed) : seed_(seed) {
+    InitLanes(lanes_, seed);
+}
+
+void ContentHasher::Update(const void* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    total_ += size;
+
+    // Top up a partial stripe left over from the previous call
+    if (stripe_size_ > 0) {
+        size_t take = sizeof(stripe_) - stripe_size_;
+        if (take > size) {
+            take = size;
+        }
+        std::memcpy(stripe_ + stripe_size_, p, take);
+        stripe_size_ += take;
+        p += take;
+        if (stripe_size_ < sizeof(stripe_)) {
+            return;
+        }
+        ConsumeStripe(lanes_, stripe_);
+        stripe_size_ = 0;
+    }
+
+    for (; p + 32 <= end; p += 32) {
+        ConsumeStripe(lanes_, p);
+    }
+    stripe_size_ = static_cast<size_t>(end - p);
+    std::memcpy(stripe_, p, stripe_size_);
+}
+
+uint64_t ContentHasher::Digest() const {
+    uint64_t h = total_ >= 32 ? MergeLanes(lanes_) : seed_ + kPrime5;
+    h += total_;
+    return Finalize(h, stripe_, stripe_ + stripe_size_);
+}
@@ -0,0 +1,35 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// ============================================================================
+// CACHING: Content Hash Shared by Client and Server
+// ============================================================================
+// Fast 64-bit content hash (XXH64-style, not cryptographic). The server keys
+// its result cache on it and clients send it to LookupByHash, so both sides
+// must compute exactly the same value for the same bytes.
+uint64_t HashContent(const void* data, size_t size, uint64_t seed = 0);
+
+// Mixes two hashes into one, e.g. a content hash with an engine settings hash
+uint64_t HashCombine(uint64_t a, uint64_t b);
+
+// Incremental form of HashContent for input that arrives in pieces, such as a
+// file read in chunks. Digest() equals HashContent over the concatenation.
+class ContentHasher {
+public:
+    explicit ContentHasher(uint64_t seed = 0);
+
+    void Update(const void* data, size_t size);
+    uint64_t Digest() const;
+
+private:
+    uint64_t seed_;
+    uint64_t lanes_[4];
+    uint8_t stripe_[32];     // Bytes not yet consumed by the lanes
+    size_t stripe_size_ = 0;
+    uint64_t total_ = 0;
+};
+
+#endif // CONTENT_HASH_H
@@ -0,0 +1,165 @@
+#include "trace_context.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+uint64_t RandomId() {
+    // One generator per thread, seeded once; ids only need to be unique
+    thread_local std::mt19937_64 generator(
+        (static_cast<uint64_t>(std::random_device()()) << 32) ^ std::random_device()());
+    uint64_t id;
+    do {
+        id = generator();
+    } while (id == 0);
+    return id;
+}
+
+std::string Hex64(uint64_t value) {
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(value));
+    return hex;
+}
+
+// Lower-case hex only, as the W3C format requires
+bool ParseHex(const std::string& text, size_t offset, size_t digits, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t i = offset; i < offset + digits; ++i) {
+        char c = text[i];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            return false;
+        }
+        result = (result << 4) | static_cast<uint64_t>(digit);
+    }
+    *value = result;
+    return true;
+}
+
+void AppendJsonString(const std::string& value, std::string* out) {
+    out->push_back('"');
+    for (unsigned char c : value) {
+        switch (c) {
+        case '"': *out += "\\\""; break;
+        case '\\': *out += "\\\\"; break;
+        case '\n': *out += "\\n"; break;
+        case '\t': *out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                *out += escaped;
+            } else {
+                out->push_back(static_cast<char>(c));
+            }
+        }
+    }
+    out->push_back('"');
+}
+
+void AppendSeparator(std::string* out) {
+    if (!out->empty()) {
+        *out += ",\n";
+    }
+}
+
+void AppendMetadata(const char* kind, int pid, int tid, const std::string& name,
+                    std::string* out) {
+    AppendSeparator(out);
+    *out += "{\"ph\":\"M\",\"name\":\"";
+    *out += kind;
+    *out += "\",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(tid) +
+            ",\"args\":{\"name\":";
+    AppendJsonString(name, out);
+    *out += "}}";
+}
+
+}  // namespace
+
+TraceContext TraceContext::NewTrace(bool sampled) {
+    TraceContext context;
+    context.trace_id_high = RandomId();
+    context.trace_id_low = RandomId();
+    context.span_id = RandomId();
+    context.sampled = sampled;
+    return context;
+}
+
+TraceContext TraceContext::NewSpan() const {
+    TraceContext child = *this;
+    child.span_id = RandomId();
+    return child;
+}
+
+std::string TraceContext::ToTraceParent() const {
+    return "00-" + TraceIdHex() + "-" + SpanIdHex() + (sampled ? "-01" : "-00");
+}
+
+bool TraceContext::FromTraceParent(const std::string& header, TraceContext* context) {
+    // version(2) - trace id(32) - span id(16) - flags(2)
+    if (header.size() < 55 || header[2] != '-' || header[35] != '-' || header[52] != '-' ||
+        header.compare(0, 2, "ff") == 0) {
+        return false;
+    }
+    TraceContext parsed;
+    uint64_t flags = 0;
+    if (!ParseHex(header, 3, 16, &parsed.trace_id_high) ||
+        !ParseHex(header, 19, 16, &parsed.trace_id_low) ||
+        !ParseHex(header, 36, 16, &parsed.span_id) ||
+        !ParseHex(header, 53, 2, &flags) ||
+        !parsed.valid()) {
+        return false;
+    }
+    parsed.sampled = (flags & 1) != 0;
+    *context = parsed;
+    return true;
+}
+
+std::string TraceContext::TraceIdHex() const {
+    return Hex64(trace_id_high) + Hex64(trace_id_low);
+}
+
+std::string TraceContext::SpanIdHex() const {
+    return Hex64(span_id);
+}
+
+int64_t WallClockMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void AppendTraceEvent(const TraceEvent& event, std::string* out) {
+    AppendSeparator(out);
+    *out += "{\"ph\":\"X\",\"name\":";
+    AppendJsonString(event.name, out);
+    *out += ",\"ts\":" + std::to_string(event.start_us) +
+            ",\"dur\":" + std::to_string(event.duration_us) +
+            ",\"pid\":" + std::to_string(event.pid) +
+            ",\"tid\":" + std::to_string(event.tid);
+    if (!event.args.empty()) {
+        *out += ",\"args\":{";
+        for (size_t i = 0; i < event.args.size(); ++i) {
+            if (i > 0) {
+                out->push_back(',');
+            }
+            AppendJsonString(event.args[i].first, out);
+            out->push_back(':');
+            AppendJsonString(event.args[i].second, out);
+        }
+        out->push_back('}');
+    }
+    out->push_back('}');
+}
+
+void AppendProcessName(int pid, const std::string& name, std::string* out) {
+    AppendMetadata("process_name", pid, 0, name, out);
+}
+
+void AppendThreadName(int pid, int tid, const std::string& name, std::string* out) {
+    AppendMetadata("thread_name", pid, tid, name, out);
+}
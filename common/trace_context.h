@@ -0,0 +1,67 @@
+#ifndef TRACE_CONTEXT_H
+#define TRACE_CONTEXT_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// MONITORING: Trace Context Shared by Client and Server
+// ============================================================================
+// Identifies one request across processes, in the W3C Trace Context format:
+// the client sends it as "traceparent" gRPC metadata, and the server tags its
+// spans for that request with the same trace id. Both sides stamp spans with
+// the wall clock, so their Chrome trace files merge into one timeline.
+constexpr char kTraceParentKey[] = "traceparent";
+
+struct TraceContext {
+    uint64_t trace_id_high = 0;  // 128-bit trace id
+    uint64_t trace_id_low = 0;
+    uint64_t span_id = 0;        // The sender's span; the parent of the receiver's
+    bool sampled = false;        // The sender records this trace and wants it recorded
+
+    bool valid() const { return (trace_id_high | trace_id_low) != 0 && span_id != 0; }
+
+    // A new trace with random ids
+    static TraceContext NewTrace(bool sampled);
+    // Same trace and sampling decision, new span id
+    TraceContext NewSpan() const;
+
+    // "00-<32 hex trace id>-<16 hex span id>-<01 or 00>"
+    std::string ToTraceParent() const;
+    // False (leaving `context` untouched) for anything malformed or all-zero
+    static bool FromTraceParent(const std::string& header, TraceContext* context);
+
+    std::string TraceIdHex() const;
+    std::string SpanIdHex() const;
+};
+
+// One complete ("ph":"X") event of the Chrome trace-event format, which
+// Perfetto and chrome://tracing open directly. Rows are (pid, tid) pairs.
+struct TraceEvent {
+    std::string name;
+    int64_t start_us = 0;     // Wall clock, microseconds since the epoch
+    int64_t duration_us = 0;
+    int pid = 0;
+    int tid = 0;
+    std::vector<std::pair<std::string, std::string>> args;  // Shown as strings
+
+    void AddArg(const std::string& key, const std::string& value) {
+        args.emplace_back(key, value);
+    }
+    void AddArg(const std::string& key, int64_t value) {
+        args.emplace_back(key, std::to_string(value));
+    }
+};
+
+int64_t WallClockMicros();
+
+// Each append writes one JSON object, preceded by a comma unless `out` is
+// empty, so a file is "[" + appended events + "]"
+void AppendTraceEvent(const TraceEvent& event, std::string* out);
+// Metadata events naming a process or one of its rows
+void AppendProcessName(int pid, const std::string& name, std::string* out);
+void AppendThreadName(int pid, int tid, const std::string& name, std::string* out);
+
+#endif // TRACE_CONTEXT_H
@@ -0,0 +1,305 @@
+#include "async_log.h"
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+
+namespace {
+
+const char* LevelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::kDebug:
+        return "DEBUG";
+    case LogLevel::kInfo:
+        return "INFO ";
+    case LogLevel::kWarning:
+        return "WARN ";
+    case LogLevel::kError:
+        return "ERROR";
+    }
+    return "?    ";
+}
+
+size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+// Wall-clock stamps to the microsecond. The date part only changes once a
+// second, so it is formatted once per second rather than once per record.
+class TimeStamper {
+public:
+    void Append(int64_t time_ns, std::string* out) {
+        time_t seconds = static_cast<time_t>(time_ns / 1000000000);
+        if (seconds != second_) {
+            struct tm local;
+            localtime_r(&seconds, &local);
+            std::strftime(date_, sizeof(date_), "%Y-%m-%d %H:%M:%S", &local);
+            second_ = seconds;
+        }
+        char micros[16];
+        std::snprintf(micros, sizeof(micros), ".%06d",
+                      static_cast<int>(time_ns % 1000000000 / 1000));
+        out->append(date_);
+        out->append(micros);
+    }
+
+private:
+    time_t second_ = -1;
+    char date_[32] = {};
+};
+
+void AppendArg(const async_log::Record& record, int index, std::string* out) {
+    const async_log::Record::Value& value = record.values[index];
+    char number[32];
+    switch (record.types[index]) {
+    case async_log::kInt:
+        std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(value.i));
+        out->append(number);
+        break;
+    case async_log::kUint:
+        std::snprintf(number, sizeof(number), "%llu",
+                      static_cast<unsigned long long>(value.u));
+        out->append(number);
+        break;
+    case async_log::kDouble:
+        std::snprintf(number, sizeof(number), "%.6g", value.d);
+        out->append(number);
+        break;
+    case async_log::kBool:
+        out->append(value.u != 0 ? "true" : "false");
+        break;
+    case async_log::kText:
+        out->append(record.text + value.text.offset, value.text.length);
+        break;
+    }
+}
+
+// One line: "<time> <LEVEL> [<thread>] <message>". Placeholders without an
+// argument are kept as "{}"; arguments without a placeholder are dropped.
+void FormatRecord(const async_log::Record& record, int thread_number, TimeStamper* stamper,
+                  std::string* out) {
+    stamper->Append(record.time_ns, out);
+    out->push_back(' ');
+    out->append(LevelName(record.level));
+    out->append(" [");
+    out->append(std::to_string(thread_number));
+    out->append("] ");
+
+    int next_arg = 0;
+    for (const char* p = record.format; *p != '\0'; ++p) {
+        if (p[0] == '{' && p[1] == '}' && next_arg < record.num_args) {
+            AppendArg(record, next_arg++, out);
+            ++p;
+        } else {
+            out->push_back(*p);
+        }
+    }
+    out->push_back('\n');
+}
+
+// Marks the thread's ring retired when the thread exits
+struct RingHandle {
+    std::shared_ptr<async_log::LogRing> ring;
+    ~RingHandle() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+}  // namespace
+
+bool ParseLogLevel(const std::string& name, LogLevel* level) {
+    if (name == "debug") {
+        *level = LogLevel::kDebug;
+    } else if (name == "info") {
+        *level = LogLevel::kInfo;
+    } else if (name == "warning") {
+        *level = LogLevel::kWarning;
+    } else if (name == "error") {
+        *level = LogLevel::kError;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+namespace async_log {
+
+LogRing::LogRing(size_t capacity, int thread_number)
+    : slots_(RoundUpToPowerOfTwo(std::max<size_t>(capacity, 2))),
+      mask_(slots_.size() - 1),
+      thread_number_(thread_number) {}
+
+void LogRing::Drain(std::vector<Record>* out) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+        out->push_back(slots_[head & mask_]);
+    }
+    head_.store(head, std::memory_order_release);
+}
+
+}  // namespace async_log
+
+AsyncLogger& AsyncLogger::Instance() {
+    static AsyncLogger logger;
+    return logger;
+}
+
+AsyncLogger::~AsyncLogger() {
+    Stop();
+}
+
+async_log::LogRing* AsyncLogger::LocalRing() {
+    thread_local RingHandle handle;
+    if (!handle.ring) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        handle.ring = std::make_shared<async_log::LogRing>(ring_records_, next_thread_number_++);
+        rings_.push_back(handle.ring);
+    }
+    return handle.ring.get();
+}
+
+void AsyncLogger::Start(const LogOptions& options) {
+    Stop();
+    level_.store(options.level, std::memory_order_relaxed);
+    sample_every_.store(std::max<uint32_t>(1, options.sample_every), std::memory_order_relaxed);
+    flush_interval_ms_ = std::max(1, options.flush_interval_ms);
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        // Threads that already logged keep their ring; new ones get this size
+        ring_records_ = options.ring_records;
+    }
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (!options.file.empty()) {
+            output_ = std::fopen(options.file.c_str(), "a");
+            if (output_ == nullptr) {
+                std::cerr << "Could not open log file " << options.file
+                          << ", logging to stdout" << std::endl;
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = false;
+    }
+    writer_ = std::thread(&AsyncLogger::WriterThread, this);
+    running_.store(true, std::memory_order_release);
+}
+
+void AsyncLogger::Stop() {
+    if (!writer_.joinable()) {
+        return;
+    }
+    running_.store(false, std::memory_order_seq_cst);
+    {
+        // SYNCHRONIZATION: A producer that saw running_ still true may be
+        // filling its slot; the final flush must not run before it commits.
+        // Threads registering now block here and then see running_ false.
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (const auto& ring : rings_) {
+            while (ring->writing()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    writer_.join();
+
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    if (output_ != nullptr) {
+        std::fclose(output_);
+        output_ = nullptr;
+    }
+}
+
+void AsyncLogger::WriteNow(const async_log::Record& record, int thread_number) {
+    TimeStamper stamper;
+    std::string line;
+    FormatRecord(record, thread_number, &stamper, &line);
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    FILE* out = output_ != nullptr ? output_ : stdout;
+    std::fwrite(line.data(), 1, line.size(), out);
+    std::fflush(out);
+}
+
+void AsyncLogger::WriterThread() {
+    for (;;) {
+        Flush();
+        std::unique_lock<std::mutex> lock(stop_mutex_);
+        if (stop_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_),
+                              [this]() { return stopping_; })) {
+            break;
+        }
+    }
+    // Anything committed between the last pass and the stop request; Stop
+    // has already waited out every log call that was using a ring
+    Flush();
+}
+
+void AsyncLogger::Flush() {
+    // Ring boundaries in pending_: (end index, thread number)
+    std::vector<std::pair<size_t, int>> spans;
+    uint64_t drops = 0;
+    pending_.clear();
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (auto it = rings_.begin(); it != rings_.end();) {
+            async_log::LogRing& ring = **it;
+            bool retired = ring.retired.load(std::memory_order_acquire);
+            ring.Drain(&pending_);
+            spans.emplace_back(pending_.size(), ring.thread_number());
+            if (retired) {
+                retired_drops_ += ring.dropped();
+                it = rings_.erase(it);
+            } else {
+                drops += ring.dropped();
+                ++it;
+            }
+        }
+        drops += retired_drops_;
+    }
+    if (pending_.empty() && drops == reported_drops_) {
+        return;
+    }
+
+    // Each ring is already in order; merge them by time
+    std::vector<std::pair<size_t, int>> order;  // (record index, thread number)
+    order.reserve(pending_.size());
+    size_t begin = 0;
+    for (const auto& span : spans) {
+        for (size_t i = begin; i < span.first; ++i) {
+            order.emplace_back(i, span.second);
+        }
+        begin = span.first;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](const auto& a, const auto& b) {
+        return pending_[a.first].time_ns < pending_[b.first].time_ns;
+    });
+
+    TimeStamper stamper;
+    std::string text;
+    text.reserve(order.size() * 96);
+    for (const auto& entry : order) {
+        FormatRecord(pending_[entry.first], entry.second, &stamper, &text);
+    }
+    if (drops > reported_drops_) {
+        text += "Log buffers full: dropped " + std::to_string(drops - reported_drops_) +
+                " records\n";
+        reported_drops_ = drops;
+    }
+
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    FILE* out = output_ != nullptr ? output_ : stdout;
+    std::fwrite(text.data(), 1, text.size(), out);
+    std::fflush(out);
+}
@@ -0,0 +1,291 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// ============================================================================
+// MONITORING: Asynchronous Structured Log
+// ============================================================================
+// A log call on the OCR path copies one fixed-size binary record into the
+// calling thread's own ring buffer: a clock read and a few stores, with no
+// formatting, no lock and no syscall. A background writer drains every ring,
+// orders the records by time, formats them and writes them to stdout or a
+// file. A full ring drops the record instead of blocking the worker, and
+// the writer reports how many were dropped.
+//
+// Messages are format strings with "{}" placeholders, filled in order from
+// integer, floating-point, bool and string arguments:
+//
+//     OCR_LOG(LogLevel::kInfo, "Completed image: {} ({} ms)", image_id, ms);
+//
+// Only the pointer to the format string is stored, so it must be a literal.
+// String arguments are copied, truncated past kTextBytes per record.
+//
+// OCR_LOG_SAMPLED keeps one in every LogOptions::sample_every calls at each
+// call site and thread, for per-image messages that would otherwise flood
+// the log at thousands of images per second.
+
+enum class LogLevel : uint8_t { kDebug, kInfo, kWarning, kError };
+
+// "debug", "info", "warning" or "error"; false for anything else
+bool ParseLogLevel(const std::string& name, LogLevel* level);
+
+struct LogOptions {
+    LogLevel level = LogLevel::kInfo;
+    uint32_t sample_every = 1;   // OCR_LOG_SAMPLED keeps 1 in N; 1 keeps all
+    std::string file;            // Appended to; empty means stdout
+    size_t ring_records = 4096;  // Per-thread ring capacity, rounded up to a power of two
+    int flush_interval_ms = 20;
+};
+
+namespace async_log {
+
+constexpr int kMaxArgs = 6;
+constexpr size_t kTextBytes = 160;
+
+enum ArgType : uint8_t { kInt, kUint, kDouble, kBool, kText };
+
+// Trivially copyable, so a ring slot is filled and drained with plain stores
+struct Record {
+    int64_t time_ns;      // System clock, for wall-time stamps
+    const char* format;
+    LogLevel level;
+    uint8_t num_args;
+    uint8_t types[kMaxArgs];
+    uint16_t text_used;
+    union Value {
+        int64_t i;
+        uint64_t u;
+        double d;
+        struct {
+            uint16_t offset;
+            uint16_t length;
+        } text;
+    } values[kMaxArgs];
+    char text[kTextBytes];  // String arguments, back to back
+};
+
+// ============================================================================
+// SYNCHRONIZATION: Single-Producer Single-Consumer Ring
+// ============================================================================
+// Written only by the thread that owns it and read only by the writer
+// thread, so two atomic indices are all the synchronization it needs. The
+// producer caches the consumer's index and only reloads it when the ring
+// looks full, so a log call normally touches no cache line the writer uses.
+class LogRing {
+public:
+    LogRing(size_t capacity, int thread_number);
+
+    // Owning thread: slot for the next record, or null (and counted as
+    // dropped) when the ring is full. Publish it with Commit().
+    Record* Reserve() {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        return &slots_[tail & mask_];
+    }
+
+    void Commit() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Owning thread: brackets a log call, so AsyncLogger::Stop can wait for
+    // one that already decided to use the ring. Sequentially consistent so
+    // the flag is visible before the caller reads AsyncLogger::running_.
+    void BeginWrite() { writing_.store(true, std::memory_order_seq_cst); }
+    void EndWrite() { writing_.store(false, std::memory_order_release); }
+    bool writing() const { return writing_.load(std::memory_order_acquire); }
+
+    // Writer thread: moves every published record to `out`
+    void Drain(std::vector<Record>* out);
+
+    int thread_number() const { return thread_number_; }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Set when the owning thread exits; the writer frees the ring once drained
+    std::atomic<bool> retired{false};
+
+private:
+    std::vector<Record> slots_;
+    const uint64_t mask_;
+    const int thread_number_;
+
+    alignas(64) std::atomic<uint64_t> tail_{0};  // Producer's next slot
+    uint64_t head_cache_ = 0;                    // Producer's view of head_
+    std::atomic<bool> writing_{false};           // Inside a log call
+    std::atomic<uint64_t> dropped_{0};
+
+    alignas(64) std::atomic<uint64_t> head_{0};  // Consumer's next slot
+};
+
+inline void AppendText(Record* record, const char* data, size_t size) {
+    size_t length = std::min(size, kTextBytes - record->text_used);
+    std::memcpy(record->text + record->text_used, data, length);
+    Record::Value& value = record->values[record->num_args];
+    value.text.offset = record->text_used;
+    value.text.length = static_cast<uint16_t>(length);
+    record->text_used = static_cast<uint16_t>(record->text_used + length);
+    record->types[record->num_args++] = kText;
+}
+
+inline void Append(Record* record, bool value) {
+    record->values[record->num_args].u = value;
+    record->types[record->num_args++] = kBool;
+}
+
+inline void Append(Record* record, const char* value) {
+    AppendText(record, value, value != nullptr ? std::strlen(value) : 0);
+}
+
+inline void Append(Record* record, std::string_view value) {
+    AppendText(record, value.data(), value.size());
+}
+
+inline void Append(Record* record, const std::string& value) {
+    AppendText(record, value.data(), value.size());
+}
+
+template <typename T>
+std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>> Append(Record* record, T value) {
+    if constexpr (std::is_enum_v<T> || std::is_signed_v<T>) {
+        record->values[record->num_args].i = static_cast<int64_t>(value);
+        record->types[record->num_args++] = kInt;
+    } else {
+        record->values[record->num_args].u = static_cast<uint64_t>(value);
+        record->types[record->num_args++] = kUint;
+    }
+}
+
+template <typename T>
+std::enable_if_t<std::is_floating_point_v<T>> Append(Record* record, T value) {
+    record->values[record->num_args].d = static_cast<double>(value);
+    record->types[record->num_args++] = kDouble;
+}
+
+}  // namespace async_log
+
+class AsyncLogger {
+public:
+    static AsyncLogger& Instance();
+
+    // Opens the output and starts the writer thread. Until Start (and after
+    // Stop) records are formatted and written on the calling thread instead.
+    void Start(const LogOptions& options);
+    // Writes everything still buffered, then joins the writer
+    void Stop();
+
+    bool Enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Per call-site and thread counter, so sampling touches no shared state
+    bool Sample(uint32_t* count) const {
+        uint32_t every = sample_every_.load(std::memory_order_relaxed);
+        return every <= 1 || (*count)++ % every == 0;
+    }
+
+    template <typename... Args>
+    void Write(LogLevel level, const char* format, const Args&... args) {
+        static_assert(sizeof...(Args) <= async_log::kMaxArgs, "Too many log arguments");
+        async_log::LogRing* ring = LocalRing();
+        ring->BeginWrite();
+        if (!running_.load(std::memory_order_seq_cst)) {
+            ring->EndWrite();
+            async_log::Record record;
+            Fill(&record, level, format, args...);
+            WriteNow(record, ring->thread_number());
+            return;
+        }
+        if (async_log::Record* record = ring->Reserve()) {
+            Fill(record, level, format, args...);
+            ring->Commit();
+        }
+        ring->EndWrite();
+    }
+
+private:
+    AsyncLogger() = default;
+    ~AsyncLogger();
+
+    template <typename... Args>
+    static void Fill(async_log::Record* record, LogLevel level, const char* format,
+                     const Args&... args) {
+        record->time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+        record->format = format;
+        record->level = level;
+        record->num_args = 0;
+        record->text_used = 0;
+        (async_log::Append(record, args), ...);
+    }
+
+    // The calling thread's ring, registered on its first log call
+    async_log::LogRing* LocalRing();
+
+    void WriteNow(const async_log::Record& record, int thread_number);
+    void WriterThread();
+    // Drains every ring and writes the records in time order
+    void Flush();
+
+    std::atomic<LogLevel> level_{LogLevel::kInfo};
+    std::atomic<uint32_t> sample_every_{1};
+    std::atomic<bool> running_{false};
+    size_t ring_records_ = 4096;
+    int flush_interval_ms_ = 20;
+
+    // SYNCHRONIZATION: Guards the ring list; taken once per thread to
+    // register and by the writer while draining
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<async_log::LogRing>> rings_;
+    int next_thread_number_ = 0;
+    uint64_t retired_drops_ = 0;   // Dropped by threads that have exited
+    uint64_t reported_drops_ = 0;
+    std::vector<async_log::Record> pending_;  // Writer's scratch, reused
+
+    // Guards the output, shared by the writer and synchronous writes
+    std::mutex output_mutex_;
+    FILE* output_ = nullptr;  // Null means stdout
+
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+#define OCR_LOG(level, ...)                                       \
+    do {                                                          \
+        if (AsyncLogger::Instance().Enabled(level)) {             \
+            AsyncLogger::Instance().Write((level), __VA_ARGS__);  \
+        }                                                         \
+    } while (0)
+
+#define OCR_LOG_SAMPLED(level, ...)                                        \
+    do {                                                                   \
+        static thread_local uint32_t ocr_log_site_count = 0;               \
+        if (AsyncLogger::Instance().Enabled(level) &&                      \
+            AsyncLogger::Instance().Sample(&ocr_log_site_count)) {         \
+            AsyncLogger::Instance().Write((level), __VA_ARGS__);           \
+        }                                                                  \
+    } while (0)
+
+#endif // ASYNC_LOG_H
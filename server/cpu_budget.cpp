@@ -0,0 +1,73 @@
+#include "cpu_budget.h"
+#include <sched.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+// CPUs allowed by a cgroup quota, or 0 when there is none
+int CgroupQuotaCpus() {
+    // cgroup v2: "max 100000" or "<quota> <period>"
+    std::ifstream v2("/sys/fs/cgroup/cpu.max");
+    std::string quota;
+    long long period = 0;
+    if (v2 >> quota >> period) {
+        if (quota == "max" || period <= 0) {
+            return 0;
+        }
+        long long limit = std::stoll(quota);
+        return limit > 0 ? static_cast<int>((limit + period - 1) / period) : 0;
+    }
+
+    // cgroup v1: quota is -1 when unlimited
+    std::ifstream v1_quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream v1_period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    long long limit = 0;
+    if (v1_quota >> limit && v1_period >> period && limit > 0 && period > 0) {
+        return static_cast<int>((limit + period - 1) / period);
+    }
+    return 0;
+}
+
+int AffinityCpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+    return static_cast<int>(std::thread::hardware_concurrency());
+}
+
+}  // namespace
+
+int AvailableCpus() {
+    int cpus = AffinityCpus();
+    int quota = CgroupQuotaCpus();
+    if (quota > 0 && (cpus <= 0 || quota < cpus)) {
+        cpus = quota;
+    }
+    return cpus > 0 ? cpus : 1;
+}
+
+int LimitEngineThreads(int threads) {
+    const char* existing = std::getenv("OMP_THREAD_LIMIT");
+    if (existing != nullptr && std::atoi(existing) > 0) {
+        return std::atoi(existing);
+    }
+    return threads < 1 ? 1 : threads;
+}
+
+void ApplyEngineThreads(int threads) {
+#ifdef _OPENMP
+    // A fixed team size; dynamic adjustment could still pick fewer threads
+    omp_set_dynamic(0);
+    omp_set_num_threads(threads < 1 ? 1 : threads);
+#else
+    (void)threads;
+#endif
+}
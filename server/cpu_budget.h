@@ -0,0 +1,23 @@
+#ifndef CPU_BUDGET_H
+#define CPU_BUDGET_H
+
+// ============================================================================
+// MULTITHREADING: CPU Budget
+// ============================================================================
+// Number of CPUs this process can actually use: the scheduler affinity mask,
+// capped by the cgroup CPU quota (v2 cpu.max, or v1 cfs_quota_us over
+// cfs_period_us) rounded up. In a container limited to 2 CPUs on a 64-core
+// host this is 2, where hardware_concurrency() would say 64. Never below 1.
+int AvailableCpus();
+
+// OpenMP threads per Tesseract engine: `threads`, at least 1, unless an
+// OMP_THREAD_LIMIT set in the environment before launch says otherwise.
+int LimitEngineThreads(int threads);
+
+// Caps the OpenMP teams started from the calling thread at `threads`, so N
+// workers use N x `threads` cores instead of N x every core. OpenMP keeps
+// this per thread and reads the environment only once, at load, so every
+// thread that runs an engine calls it first. A no-op without OpenMP.
+void ApplyEngineThreads(int threads);
+
+#endif // CPU_BUDGET_H
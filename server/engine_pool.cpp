@@ -0,0 +1,305 @@
+#include "engine_pool.h"
+#include "async_log.h"
+#include "model_cache.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+constexpr size_t kMaxLanguageLength = 64;
+constexpr int kMaxVariables = 32;
+constexpr size_t kMaxTextValueLength = 512;
+
+// Engine memory beyond its traineddata: page layout, classifier and LSTM
+// working buffers. A rough allowance; the cap is an estimate either way.
+constexpr size_t kEngineOverheadBytes = 24 * 1024 * 1024;
+
+bool IsNameChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+// Language strings become file names under tessdata, so only plain names
+// joined by '+' are accepted (no paths)
+bool IsValidLanguage(const std::string& language) {
+    if (language.empty() || language.size() > kMaxLanguageLength ||
+        language.front() == '+' || language.back() == '+') {
+        return false;
+    }
+    return std::all_of(language.begin(), language.end(),
+                       [](char c) { return IsNameChar(c) || c == '+' || c == '-'; });
+}
+
+// FAULT TOLERANCE: Clients may set only these variables, each with a
+// checked value. Tesseract has hundreds, and some read or write files, name
+// traineddata to load, or turn on debug output; an allowlist keeps every new
+// one out until someone has looked at it.
+enum class VariableKind { kBool, kInt, kText };
+
+struct AllowedVariable {
+    const char* name;
+    VariableKind kind;
+    int min = 0;  // kInt: inclusive range; kText: ignored
+    int max = 0;
+};
+
+const AllowedVariable kAllowedVariables[] = {
+    {"tessedit_char_whitelist", VariableKind::kText},
+    {"tessedit_char_blacklist", VariableKind::kText},
+    {"tessedit_char_unblacklist", VariableKind::kText},
+    {"preserve_interword_spaces", VariableKind::kBool},
+    {"tessedit_do_invert", VariableKind::kBool},
+    {"tessedit_enable_dict_correction", VariableKind::kBool},
+    {"load_system_dawg", VariableKind::kBool},
+    {"load_freq_dawg", VariableKind::kBool},
+    {"classify_bln_numeric_mode", VariableKind::kBool},
+    {"textord_heavy_nr", VariableKind::kBool},
+    {"user_defined_dpi", VariableKind::kInt, 70, 2400},
+    {"thresholding_method", VariableKind::kInt, 0, 2},
+    {"lstm_choice_mode", VariableKind::kInt, 0, 2},
+};
+
+const AllowedVariable* FindAllowedVariable(const std::string& name) {
+    for (const AllowedVariable& variable : kAllowedVariables) {
+        if (name == variable.name) {
+            return &variable;
+        }
+    }
+    return nullptr;
+}
+
+// The spellings Tesseract's BoolParam accepts, and integers without the
+// leading junk or trailing text that atoi would let through
+bool IsValidValue(const AllowedVariable& variable, const std::string& value) {
+    switch (variable.kind) {
+    case VariableKind::kBool:
+        return value == "0" || value == "1" || value == "T" || value == "F" ||
+               value == "true" || value == "false";
+    case VariableKind::kInt: {
+        if (value.empty() || value.size() > 6) {
+            return false;
+        }
+        size_t start = value[0] == '-' ? 1 : 0;
+        if (start == value.size() ||
+            !std::all_of(value.begin() + start, value.end(),
+                         [](char c) { return c >= '0' && c <= '9'; })) {
+            return false;
+        }
+        int number = std::stoi(value);
+        return number >= variable.min && number <= variable.max;
+    }
+    case VariableKind::kText:
+        // Character sets: printable, no control characters
+        return value.size() <= kMaxTextValueLength &&
+               std::none_of(value.begin(), value.end(), [](char c) {
+                   return static_cast<unsigned char>(c) < 0x20 || c == 0x7f;
+               });
+    }
+    return false;
+}
+
+}  // namespace
+
+bool EngineConfig::FromProto(const ocrservice::EngineOptions& options,
+                             EngineConfig* config, std::string* error) {
+    *config = EngineConfig();
+
+    if (!options.language().empty()) {
+        if (!IsValidLanguage(options.language())) {
+            *error = "Invalid language: " + options.language();
+            return false;
+        }
+        config->language = options.language();
+    }
+    if (options.has_page_seg_mode()) {
+        if (options.page_seg_mode() < 0 || options.page_seg_mode() >= tesseract::PSM_COUNT) {
+            *error = "Invalid page_seg_mode: " + std::to_string(options.page_seg_mode());
+            return false;
+        }
+        config->page_seg_mode = options.page_seg_mode();
+    }
+    if (options.has_engine_mode()) {
+        if (options.engine_mode() < 0 || options.engine_mode() >= tesseract::OEM_COUNT) {
+            *error = "Invalid engine_mode: " + std::to_string(options.engine_mode());
+            return false;
+        }
+        config->engine_mode = options.engine_mode();
+    }
+
+    if (options.variables_size() > kMaxVariables) {
+        *error = "Too many variables";
+        return false;
+    }
+    for (const auto& variable : options.variables()) {
+        const std::string& name = variable.first;
+        if (name.empty() || !std::all_of(name.begin(), name.end(), IsNameChar)) {
+            *error = "Invalid variable name: " + name;
+            return false;
+        }
+        const AllowedVariable* allowed = FindAllowedVariable(name);
+        if (allowed == nullptr) {
+            *error = "Variable not allowed: " + name;
+            return false;
+        }
+        if (!IsValidValue(*allowed, variable.second)) {
+            *error = "Invalid value for " + name;
+            return false;
+        }
+        config->variables.emplace_back(name, variable.second);
+    }
+    // Map order is unspecified; the key must not depend on it
+    std::sort(config->variables.begin(), config->variables.end());
+    return true;
+}
+
+std::string EngineConfig::Key() const {
+    std::ostringstream key;
+    key << language;
+    if (engine_mode != tesseract::OEM_DEFAULT) {
+        key << "|oem=" << engine_mode;
+    }
+    if (page_seg_mode >= 0) {
+        key << "|psm=" << page_seg_mode;
+    }
+    for (const auto& variable : variables) {
+        key << '|' << variable.first << '=' << variable.second;
+    }
+    return key.str();
+}
+
+EnginePool::Lease::Lease(EnginePool* pool, std::unique_ptr<Engine> engine)
+    : pool_(pool), engine_(std::move(engine)) {}
+
+EnginePool::Lease& EnginePool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        Return();
+        pool_ = other.pool_;
+        engine_ = std::move(other.engine_);
+    }
+    return *this;
+}
+
+EnginePool::Lease::~Lease() {
+    Return();
+}
+
+void EnginePool::Lease::Return() {
+    if (engine_) {
+        pool_->Release(std::move(engine_));
+    }
+}
+
+tesseract::TessBaseAPI* EnginePool::Lease::operator->() const {
+    return &engine_->api;
+}
+
+tesseract::TessBaseAPI& EnginePool::Lease::operator*() const {
+    return engine_->api;
+}
+
+EnginePool::EnginePool(size_t memory_limit) : memory_limit_(memory_limit) {}
+
+EnginePool::~EnginePool() {
+    for (auto& engine : idle_) {
+        engine->api.End();
+    }
+}
+
+EnginePool::Lease EnginePool::Acquire(const EngineConfig& config, std::string* error) {
+    std::string key = config.Key();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = idle_by_key_.find(key);
+        if (it != idle_by_key_.end() && !it->second.empty()) {
+            IdleList::iterator position = it->second.back();
+            it->second.pop_back();
+            std::unique_ptr<Engine> engine = std::move(*position);
+            idle_.erase(position);
+            return Lease(this, std::move(engine));
+        }
+    }
+
+    // Slow path, outside the lock so other configurations are not held up
+    auto engine = std::make_unique<Engine>();
+    engine->key = key;
+    std::vector<std::string> names;
+    std::vector<std::string> values;
+    for (const auto& variable : config.variables) {
+        names.push_back(variable.first);
+        values.push_back(variable.second);
+    }
+    // Variables go through Init so init-only ones (dictionaries) apply too.
+    // Traineddata is read through the process-wide mapping, not from disk.
+    if (engine->api.Init(nullptr, 0, config.language.c_str(),
+                         static_cast<tesseract::OcrEngineMode>(config.engine_mode),
+                         nullptr, 0, &names, &values, false, &ModelCache::Read) != 0) {
+        *error = "Could not initialize Tesseract for language '" + config.language + "'";
+        return Lease();
+    }
+    if (config.page_seg_mode >= 0) {
+        engine->api.SetPageSegMode(static_cast<tesseract::PageSegMode>(config.page_seg_mode));
+    }
+    engine->cost = EstimateCost(engine->api, config.language);
+    OCR_LOG(LogLevel::kInfo, "Initialized Tesseract engine [{}]", key);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++engines_;
+    memory_ += engine->cost;
+    EvictIdleLocked();
+    return Lease(this, std::move(engine));
+}
+
+void EnginePool::Release(std::unique_ptr<Engine> engine) {
+    engine->api.Clear();  // Drop the last image and its results
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::string& key = engine->key;
+    idle_.push_front(std::move(engine));
+    idle_by_key_[key].push_back(idle_.begin());
+    EvictIdleLocked();
+}
+
+// CACHING: LRU eviction of idle engines; requires mutex_
+void EnginePool::EvictIdleLocked() {
+    while (memory_ > memory_limit_ && !idle_.empty()) {
+        std::unique_ptr<Engine>& victim = idle_.back();
+        std::vector<IdleList::iterator>& same_key = idle_by_key_[victim->key];
+        same_key.erase(std::find(same_key.begin(), same_key.end(), std::prev(idle_.end())));
+        if (same_key.empty()) {
+            idle_by_key_.erase(victim->key);
+        }
+        OCR_LOG(LogLevel::kInfo, "Evicting Tesseract engine [{}]", victim->key);
+        memory_ -= victim->cost;
+        --engines_;
+        victim->api.End();
+        idle_.pop_back();
+    }
+}
+
+// Traineddata size of every language in the engine plus a fixed overhead
+size_t EnginePool::EstimateCost(tesseract::TessBaseAPI& api, const std::string& language) {
+    std::string datapath = api.GetDatapath() != nullptr ? api.GetDatapath() : "";
+    if (!datapath.empty() && datapath.back() != '/') {
+        datapath += '/';
+    }
+    size_t cost = kEngineOverheadBytes;
+    std::istringstream languages(language);
+    std::string name;
+    while (std::getline(languages, name, '+')) {
+        struct stat info;
+        if (::stat((datapath + name + ".traineddata").c_str(), &info) == 0) {
+            cost += static_cast<size_t>(info.st_size);
+        }
+    }
+    return cost;
+}
+
+size_t EnginePool::engines() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return engines_;
+}
+
+size_t EnginePool::memory() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_;
+}
@@ -0,0 +1,100 @@
+#ifndef ENGINE_POOL_H
+#define ENGINE_POOL_H
+
+#include <tesseract/baseapi.h>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ocr_service.pb.h"
+
+// Validated, normalized Tesseract configuration of one request. Requests
+// with the same Key() share engines and cached results.
+struct EngineConfig {
+    std::string language = "eng";
+    int engine_mode = tesseract::OEM_DEFAULT;
+    int page_seg_mode = -1;  // -1 keeps the engine's default
+    std::vector<std::pair<std::string, std::string>> variables;  // Sorted by name
+
+    // Checks options that come straight from a client; returns false and
+    // sets `error` for anything out of range or unsafe
+    static bool FromProto(const ocrservice::EngineOptions& options,
+                          EngineConfig* config, std::string* error);
+
+    // Canonical text form: just the language for the defaults ("eng"),
+    // otherwise e.g. "deu|oem=1|psm=7|tessedit_char_whitelist=0123456789"
+    std::string Key() const;
+};
+
+// ============================================================================
+// MULTITHREADING: Pool of Initialized Tesseract Engines
+// ============================================================================
+// TessBaseAPI::Init parses traineddata and takes hundreds of milliseconds
+// (ModelCache only spares it opening and reading the files again), so
+// initialized engines are kept per configuration and leased to a worker for
+// one recognition at a time. Engines are created on the first request for a
+// configuration (concurrent misses each create one, so busy configurations
+// get as many engines as they have workers). Idle engines are evicted least
+// recently used first while the estimated memory of all engines exceeds the
+// cap; leased engines are never evicted, so the cap is soft while all are busy.
+class EnginePool {
+    struct Engine;
+
+public:
+    // Exclusive use of one engine; returns it to the pool when destroyed
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept = default;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        explicit operator bool() const { return engine_ != nullptr; }
+        tesseract::TessBaseAPI* operator->() const;
+        tesseract::TessBaseAPI& operator*() const;
+
+    private:
+        friend class EnginePool;
+        Lease(EnginePool* pool, std::unique_ptr<Engine> engine);
+        void Return();
+
+        EnginePool* pool_ = nullptr;
+        std::unique_ptr<Engine> engine_;
+    };
+
+    explicit EnginePool(size_t memory_limit);
+    ~EnginePool();
+
+    // An idle engine for `config`, or a newly initialized one. Empty lease
+    // with `error` set when Tesseract cannot load the configuration.
+    Lease Acquire(const EngineConfig& config, std::string* error);
+
+    size_t engines() const;
+    size_t memory() const;  // Estimated bytes held by all engines
+
+private:
+    struct Engine {
+        std::string key;
+        tesseract::TessBaseAPI api;
+        size_t cost = 0;
+    };
+    using IdleList = std::list<std::unique_ptr<Engine>>;
+
+    void Release(std::unique_ptr<Engine> engine);
+    void EvictIdleLocked();
+    static size_t EstimateCost(tesseract::TessBaseAPI& api, const std::string& language);
+
+    const size_t memory_limit_;
+    mutable std::mutex mutex_;
+    IdleList idle_;  // Most recently used at the front
+    std::unordered_map<std::string, std::vector<IdleList::iterator>> idle_by_key_;
+    size_t engines_ = 0;  // Idle and leased
+    size_t memory_ = 0;
+};
+
+#endif // ENGINE_POOL_H
@@ -0,0 +1,98 @@
+#include "health_service.h"
+#include <chrono>
+
+using grpc::health::v1::HealthCheckRequest;
+using grpc::health::v1::HealthCheckResponse;
+
+namespace {
+
+// How often a Watch with no status change checks for cancellation
+constexpr auto kWatchPollInterval = std::chrono::seconds(1);
+
+}  // namespace
+
+HealthService::HealthService(const std::vector<std::string>& services) {
+    serving_[""] = false;
+    for (const std::string& service : services) {
+        serving_[service] = false;
+    }
+}
+
+HealthService::ServingStatus HealthService::StatusOf(const std::string& service) const {
+    auto it = serving_.find(service);
+    if (it == serving_.end()) {
+        return HealthCheckResponse::SERVICE_UNKNOWN;
+    }
+    return it->second ? HealthCheckResponse::SERVING : HealthCheckResponse::NOT_SERVING;
+}
+
+grpc::Status HealthService::Check(grpc::ServerContext* context, const HealthCheckRequest* request,
+                                  HealthCheckResponse* response) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ServingStatus status = StatusOf(request->service());
+    if (status == HealthCheckResponse::SERVICE_UNKNOWN) {
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "Unknown service");
+    }
+    response->set_status(status);
+    return grpc::Status::OK;
+}
+
+grpc::Status HealthService::Watch(grpc::ServerContext* context, const HealthCheckRequest* request,
+                                  grpc::ServerWriter<HealthCheckResponse>* writer) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        HealthCheckResponse response;
+        response.set_status(StatusOf(request->service()));
+        bool stopping = shutdown_;
+        lock.unlock();
+        if (!writer->Write(response) || stopping) {
+            return grpc::Status::OK;
+        }
+        lock.lock();
+
+        // SYNCHRONIZATION: Sleep until the status changes, waking now and
+        // then to notice a client that went away
+        ServingStatus sent = response.status();
+        while (!shutdown_ && StatusOf(request->service()) == sent) {
+            if (context->IsCancelled()) {
+                return grpc::Status::CANCELLED;
+            }
+            changed_.wait_for(lock, kWatchPollInterval);
+        }
+    }
+}
+
+void HealthService::SetServingStatus(const std::string& service_name, bool serving) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_) {
+            return;
+        }
+        serving_[service_name] = serving;
+    }
+    changed_.notify_all();
+}
+
+void HealthService::SetServingStatus(bool serving) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shutdown_) {
+            return;
+        }
+        for (auto& entry : serving_) {
+            entry.second = serving;
+        }
+    }
+    changed_.notify_all();
+}
+
+void HealthService::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : serving_) {
+            entry.second = false;
+        }
+        shutdown_ = true;
+    }
+    changed_.notify_all();
+}
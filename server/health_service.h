@@ -0,0 +1,54 @@
+#ifndef HEALTH_SERVICE_H
+#define HEALTH_SERVICE_H
+
+#include <grpcpp/grpcpp.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "health.grpc.pb.h"
+
+// ============================================================================
+// MONITORING: gRPC Health Checking
+// ============================================================================
+// The standard grpc.health.v1.Health service, for load balancers and
+// readiness probes. gRPC's built-in one reports SERVING for "" from the
+// moment the listener starts, before the server can turn it off. This one
+// starts every service it knows at NOT_SERVING, so no probe ever sees
+// SERVING until SetServingStatus says so.
+class HealthService final : public grpc::health::v1::Health::Service {
+public:
+    // "" (the whole server) and `services` are known from the start
+    explicit HealthService(const std::vector<std::string>& services);
+
+    grpc::Status Check(grpc::ServerContext* context,
+                       const grpc::health::v1::HealthCheckRequest* request,
+                       grpc::health::v1::HealthCheckResponse* response) override;
+
+    // Streams the current status, then every change, until the call is
+    // cancelled or the service shuts down
+    grpc::Status Watch(grpc::ServerContext* context,
+                       const grpc::health::v1::HealthCheckRequest* request,
+                       grpc::ServerWriter<grpc::health::v1::HealthCheckResponse>* writer) override;
+
+    // Same semantics as grpc::HealthCheckServiceInterface. A name not yet
+    // known is added.
+    void SetServingStatus(const std::string& service_name, bool serving);
+    void SetServingStatus(bool serving);  // Every known service
+    // Everything NOT_SERVING from here on; later changes are ignored
+    void Shutdown();
+
+private:
+    using ServingStatus = grpc::health::v1::HealthCheckResponse::ServingStatus;
+
+    // SERVICE_UNKNOWN for names never registered. Caller holds mutex_.
+    ServingStatus StatusOf(const std::string& service) const;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::map<std::string, bool> serving_;
+    bool shutdown_ = false;
+};
+
+#endif // HEALTH_SERVICE_H
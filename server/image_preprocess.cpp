@@ -0,0 +1,131 @@
+#include "image_preprocess.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Replaces `image` with `next` when a Leptonica step produced a result,
+// carrying the resolution over so Tesseract still sees the right DPI.
+void Replace(PixPtr& image, PIX* next) {
+    if (next == nullptr || next == image.get()) {
+        return;
+    }
+    if (pixGetXRes(next) == 0) {
+        pixCopyResolution(next, image.get());
+    }
+    image.reset(next);
+}
+
+// Every Nth pixel is enough to tell a blank gap from a line of text
+constexpr int kInkSampleStep = 4;
+
+// Darkness of one row: set bits for 1 bpp, inverted gray level for 8 bpp
+int64_t RowInk(PIX* image, int y) {
+    int width = pixGetWidth(image);
+    bool binary = pixGetDepth(image) == 1;
+    l_uint32* line = pixGetData(image) + static_cast<size_t>(y) * pixGetWpl(image);
+
+    int64_t ink = 0;
+    for (int x = 0; x < width; x += kInkSampleStep) {
+        ink += binary ? GET_DATA_BIT(line, x) : 255 - GET_DATA_BYTE(line, x);
+    }
+    return ink;
+}
+
+std::vector<PixPtr> WholePage(PIX* image) {
+    std::vector<PixPtr> strips;
+    strips.emplace_back(pixClone(image));
+    return strips;
+}
+
+}  // namespace
+
+PixPtr PreprocessImage(PixPtr image, const PreprocessOptions& options) {
+    if (options.grayscale) {
+        // 1 bpp images are already as small as they get; leave them binary
+        int depth = pixGetDepth(image.get());
+        if ((depth > 1 && depth != 8) || (depth == 8 && pixGetColormap(image.get()))) {
+            Replace(image, pixConvertTo8(image.get(), 0));
+        }
+    }
+
+    if (options.target_dpi > 0) {
+        // Only rescale when the file states its resolution and it is off by >10%
+        int dpi = pixGetXRes(image.get());
+        if (dpi > 0 && std::abs(dpi - options.target_dpi) * 10 > options.target_dpi) {
+            float scale = static_cast<float>(options.target_dpi) / dpi;
+            Replace(image, pixScale(image.get(), scale, scale));
+            pixSetResolution(image.get(), options.target_dpi, options.target_dpi);
+        }
+    }
+
+    if (options.deskew) {
+        Replace(image, pixDeskew(image.get(), 0));
+    }
+
+    if (options.binarize && pixGetDepth(image.get()) == 8) {
+        PIX* binary = nullptr;
+        if (pixOtsuAdaptiveThreshold(image.get(), 2000, 2000, 0, 0, 0.1f,
+                                     nullptr, &binary) == 0) {
+            Replace(image, binary);
+        }
+    }
+
+    return image;
+}
+
+std::vector<PixPtr> SplitIntoStrips(PIX* image, int strip_height, int overlap) {
+    int width = pixGetWidth(image);
+    int height = pixGetHeight(image);
+    if (strip_height <= 0 || height < strip_height * 3 / 2) {
+        return WholePage(image);
+    }
+
+    // Row darkness is measured on binary or plain 8-bit gray data
+    PixPtr converted;
+    PIX* measure = image;
+    int depth = pixGetDepth(image);
+    if (depth != 1 && (depth != 8 || pixGetColormap(image))) {
+        converted.reset(pixConvertTo8(image, 0));
+        measure = converted.get();
+        if (measure == nullptr) {
+            return WholePage(image);
+        }
+    }
+
+    // Pick each cut as the lightest row within a quarter strip of its
+    // nominal position; the last strip is at least half a strip tall
+    std::vector<int> cuts = {0};
+    int search = strip_height / 4;
+    for (int nominal = strip_height; nominal < height - strip_height / 2;
+         nominal = cuts.back() + strip_height) {
+        int best = nominal;
+        int64_t best_ink = std::numeric_limits<int64_t>::max();
+        int first = std::max(cuts.back() + 1, nominal - search);
+        int last = std::min(height - 1, nominal + search);
+        for (int y = first; y <= last; ++y) {
+            int64_t ink = RowInk(measure, y);
+            if (ink < best_ink) {
+                best_ink = ink;
+                best = y;
+            }
+        }
+        cuts.push_back(best);
+    }
+    cuts.push_back(height);
+
+    std::vector<PixPtr> strips;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        int top = std::max(0, cuts[i] - overlap);
+        int bottom = std::min(height, cuts[i + 1] + overlap);
+        BOX* box = boxCreate(0, top, width, bottom - top);
+        PIX* strip = pixClipRectangle(image, box, nullptr);
+        boxDestroy(&box);
+        if (strip == nullptr) {
+            return WholePage(image);
+        }
+        strips.emplace_back(strip);
+    }
+    return strips;
+}
@@ -0,0 +1,36 @@
+#ifndef IMAGE_PREPROCESS_H
+#define IMAGE_PREPROCESS_H
+
+#include <leptonica/allheaders.h>
+#include <memory>
+#include <vector>
+
+// Owning handle for a Leptonica image, for PIX objects that sit in queues.
+struct PixDeleter {
+    void operator()(PIX* pix) const { pixDestroy(&pix); }
+};
+using PixPtr = std::unique_ptr<PIX, PixDeleter>;
+
+// Cleanup applied by the decode stage before an image reaches Tesseract.
+struct PreprocessOptions {
+    bool grayscale = true;  // Convert color/palette images to 8-bit gray
+    bool deskew = false;    // Detect and correct page skew
+    bool binarize = false;  // Adaptive Otsu threshold to 1 bpp
+    int target_dpi = 0;     // Rescale to this resolution when known; 0 keeps it
+};
+
+// ============================================================================
+// IMAGE PROCESSING: Decode-Stage Preprocessing
+// ============================================================================
+// Runs the enabled steps in a fixed order (gray, DPI, deskew, binarize) so
+// each later step works on the smallest image. Never returns null: a step
+// that fails leaves the image as it was.
+PixPtr PreprocessImage(PixPtr image, const PreprocessOptions& options);
+
+// Splits a page into horizontal strips roughly `strip_height` rows tall, in
+// reading order. Each cut is moved to the lightest row near its nominal
+// position so text lines stay whole, and strips are padded by `overlap` rows
+// on each side. Returns a single strip when the page is not worth splitting.
+std::vector<PixPtr> SplitIntoStrips(PIX* image, int strip_height, int overlap);
+
+#endif // IMAGE_PREPROCESS_H
@@ -1,35 +1,216 @@
 #include "ocr_server.h"
+#include "cpu_budget.h"
+#include "health_service.h"
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 
-void RunServer(const std::string& server_address, int num_threads) {
-    OCRServiceImpl service(num_threads);
+namespace {
+
+std::atomic<bool> g_shutdown_requested(false);
+
+void HandleShutdownSignal(int) {
+    g_shutdown_requested = true;
+}
+
+}  // namespace
+
+void RunServer(const std::string& server_address, const ServerOptions& options) {
+    OCRServiceImpl service(options);
+
+    // MONITORING: Both the whole server ("") and OCRService report
+    // NOT_SERVING from the first connection until the service is ready, so
+    // load balancers and readiness probes hold traffic until engines are warm
+    HealthService health({ocrservice::OCRService::service_full_name()});
 
     grpc::ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
     builder.RegisterService(&service);
+    builder.RegisterService(&health);
+
+    // Async engine: one completion queue per polling thread
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> completion_queues;
+    if (options.async_engine) {
+        for (int i = 0; i < options.cq_threads; ++i) {
+            completion_queues.push_back(builder.AddCompletionQueue());
+        }
+    }
 
     std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-    std::cout << "Server listening on " << server_address << std::endl;
-    std::cout << "Using " << num_threads << " worker threads" << std::endl;
+    OCR_LOG(LogLevel::kInfo, "Server listening on {}", server_address);
+
+    std::thread readiness_watcher([&service, &health]() {
+        while (!g_shutdown_requested) {
+            if (service.WaitUntilReady(std::chrono::milliseconds(200))) {
+                health.SetServingStatus(true);
+                return;
+            }
+        }
+    });
+
+    std::vector<std::thread> cq_threads;
+    for (auto& cq : completion_queues) {
+        cq_threads.emplace_back(&OCRServiceImpl::HandleAsyncCalls, &service, cq.get());
+    }
+    if (options.async_engine) {
+        OCR_LOG(LogLevel::kInfo, "Async engine enabled with {} completion queue threads",
+                options.cq_threads);
+    }
+
+    // FAULT TOLERANCE: Shut down cleanly on Ctrl+C / SIGTERM so service.Shutdown()
+    // drains the workers and persists the result cache
+    std::signal(SIGINT, HandleShutdownSignal);
+    std::signal(SIGTERM, HandleShutdownSignal);
+    std::thread shutdown_watcher([&server, &health]() {
+        while (!g_shutdown_requested) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        OCR_LOG(LogLevel::kInfo, "Shutting down...");
+        // Every service reports NOT_SERVING from here on
+        health.Shutdown();
+        server->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(5));
+    });
 
     server->Wait();
+    shutdown_watcher.join();
+    readiness_watcher.join();
+
+    // Workers still finishing async calls post their responses to the
+    // completion queues, so the pipelines drain while the queues are polled
+    service.Shutdown();
+    for (auto& cq : completion_queues) {
+        cq->Shutdown();
+    }
+    for (auto& thread : cq_threads) {
+        thread.join();
+    }
+}
+
+// Boolean flags accept "--name", "--name=1" and "--name=0".
+bool ParseBool(const std::string& value) {
+    return value.empty() || value == "1" || value == "true";
+}
+
+// Parses "--name=value" style flags; returns false for unknown flags.
+bool ParseFlag(const std::string& arg, ServerOptions& options) {
+    std::string name = arg.substr(2);
+    std::string value;
+    size_t eq = name.find('=');
+    if (eq != std::string::npos) {
+        value = name.substr(eq + 1);
+        name = name.substr(0, eq);
+    }
+
+    if (name == "async") {
+        options.async_engine = ParseBool(value);
+    } else if (name == "cq_threads") {
+        options.cq_threads = std::stoi(value);
+    } else if (name == "cache_mb") {
+        options.cache_mb = std::stoul(value);
+    } else if (name == "cache_shards") {
+        options.cache_shards = std::stoi(value);
+    } else if (name == "cache_file") {
+        options.cache_file = value;
+    } else if (name == "max_queue_depth") {
+        options.max_queue_depth = std::stoi(value);
+    } else if (name == "max_queued_mb") {
+        options.max_queued_mb = std::stoul(value);
+    } else if (name == "metrics_file") {
+        options.metrics_file = value;
+    } else if (name == "metrics_interval_ms") {
+        options.metrics_interval_ms = std::stoi(value);
+    } else if (name == "upload_memory_mb") {
+        options.upload_memory_mb = std::stoul(value);
+    } else if (name == "max_upload_mb") {
+        options.max_upload_mb = std::stoul(value);
+    } else if (name == "upload_spool_dir") {
+        options.upload_spool_dir = value;
+    } else if (name == "engine_memory_mb") {
+        options.engine_memory_mb = std::stoul(value);
+    } else if (name == "fast_pass") {
+        options.fast_pass = ParseBool(value);
+    } else if (name == "fast_pass_scale") {
+        options.fast_pass_scale = std::stod(value);
+    } else if (name == "fast_pass_min_confidence") {
+        options.fast_pass_min_confidence = std::stoi(value);
+    } else if (name == "fast_pass_oem") {
+        options.fast_pass_oem = std::stoi(value);
+    } else if (name == "min_threads") {
+        options.min_threads = std::stoi(value);
+    } else if (name == "max_threads") {
+        options.max_threads = std::stoi(value);
+    } else if (name == "autoscale") {
+        options.autoscale = ParseBool(value);
+    } else if (name == "autoscale_interval_ms") {
+        options.autoscale_interval_ms = std::stoi(value);
+    } else if (name == "engine_threads") {
+        options.engine_threads = std::stoi(value);
+    } else if (name == "decode_threads") {
+        options.decode_threads = std::stoi(value);
+    } else if (name == "max_ready_images") {
+        options.max_ready_images = std::stoi(value);
+    } else if (name == "block_height") {
+        options.block_height = std::stoi(value);
+    } else if (name == "grayscale") {
+        options.preprocess.grayscale = ParseBool(value);
+    } else if (name == "deskew") {
+        options.preprocess.deskew = ParseBool(value);
+    } else if (name == "binarize") {
+        options.preprocess.binarize = ParseBool(value);
+    } else if (name == "target_dpi") {
+        options.preprocess.target_dpi = std::stoi(value);
+    } else if (name == "log_level") {
+        return ParseLogLevel(value, &options.log.level);
+    } else if (name == "log_sample") {
+        options.log.sample_every = std::stoul(value);
+    } else if (name == "log_file") {
+        options.log.file = value;
+    } else if (name == "trace_sample") {
+        options.trace_sample = std::stoul(value);
+    } else if (name == "trace_buffer") {
+        options.trace_buffer = std::stoul(value);
+    } else if (name == "trace_file") {
+        options.trace_file = value;
+    } else if (name == "ready_engines") {
+        options.ready_engines = std::stoi(value);
+    } else {
+        return false;
+    }
+    return true;
 }
 
 int main(int argc, char** argv) {
     std::string server_address = "0.0.0.0:50051";
-    int num_threads = 4;
+    ServerOptions options;
 
-    if (argc > 1) {
-        server_address = argv[1];
+    // Usage: ocr_server [address] [num_threads] [--flag[=value] ...]
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0) {
+            if (!ParseFlag(arg, options)) {
+                std::cerr << "Unknown flag: " << arg << std::endl;
+                return 1;
+            }
+        } else if (positional == 0) {
+            server_address = arg;
+            ++positional;
+        } else if (positional == 1) {
+            options.num_threads = std::stoi(arg);
+            ++positional;
+        }
     }
 
-    if (argc > 2) {
-        num_threads = std::stoi(argv[2]);
-    }
+    // MULTITHREADING: Each recognition worker applies this to itself
+    options.engine_threads = LimitEngineThreads(options.engine_threads);
 
-    std::cout << "Starting OCR Server..." << std::endl;
-    RunServer(server_address, num_threads);
+    // MONITORING: Everything after this logs through the asynchronous writer
+    AsyncLogger::Instance().Start(options.log);
+    OCR_LOG(LogLevel::kInfo, "Starting OCR Server...");
+    RunServer(server_address, options);
+    AsyncLogger::Instance().Stop();
 
     return 0;
 }
@@ -0,0 +1,249 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+const char* const kStageNames[ServerMetrics::kNumStages] = {
+    "receive", "queue_wait", "decode", "ready_wait", "recognize", "write", "total"};
+
+const char* const kErrorNames[ServerMetrics::kNumErrorKinds] = {
+    "rejected", "shed", "unsupported", "decode", "recognition"};
+
+double ToMillis(uint64_t micros) {
+    return micros / 1000.0;
+}
+
+void AddWorkers(const char* pool, const std::vector<uint64_t>& busy_micros,
+                double uptime_seconds, ocrservice::StatsResponse* stats) {
+    for (size_t i = 0; i < busy_micros.size(); ++i) {
+        ocrservice::WorkerStats* worker = stats->add_workers();
+        worker->set_pool(pool);
+        worker->set_index(static_cast<int>(i));
+        worker->set_busy_seconds(busy_micros[i] / 1e6);
+        if (uptime_seconds > 0) {
+            worker->set_utilization(worker->busy_seconds() / uptime_seconds);
+        }
+    }
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : count_(0), sum_(0), max_(0) {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Values below kSubBuckets get a bucket each; above that, the leading bit
+// picks the power of two and the next four bits the linear sub-bucket.
+int LatencyHistogram::BucketFor(uint64_t value) {
+    if (value < kSubBuckets) {
+        return static_cast<int>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int group = msb - kSubBucketBits + 1;
+    int sub = static_cast<int>(value >> (group - 1)) - kSubBuckets;
+    return group * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int index) {
+    int group = index / kSubBuckets;
+    uint64_t sub = index % kSubBuckets;
+    if (group == 0) {
+        return sub;
+    }
+    return ((sub + kSubBuckets + 1) << (group - 1)) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t micros) {
+    buckets_[BucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+
+    uint64_t seen = max_.load(std::memory_order_relaxed);
+    while (micros > seen &&
+           !max_.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {
+    }
+}
+
+// Buckets are read without a lock, so a snapshot taken under load may be off
+// by the handful of samples recorded while it was being read.
+uint64_t LatencyHistogram::Percentile(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+ServerMetrics::ServerMetrics(int decode_workers, int recognition_workers)
+    : start_(std::chrono::steady_clock::now()),
+      requests_(0), completed_(0), failed_(0), in_flight_(0),
+      decode_busy_(decode_workers), recognition_busy_(recognition_workers) {
+    for (auto& errors : errors_) {
+        errors.store(0, std::memory_order_relaxed);
+    }
+    for (auto& paths : recognition_paths_) {
+        paths.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t ServerMetrics::MicrosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void ServerMetrics::AddBusyTime(Pool pool, int worker, uint64_t micros) {
+    std::vector<BusyCounter>& counters =
+        pool == kDecodePool ? decode_busy_ : recognition_busy_;
+    counters[worker].micros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+uint64_t ServerMetrics::BusyMicros(Pool pool) const {
+    const std::vector<BusyCounter>& counters =
+        pool == kDecodePool ? decode_busy_ : recognition_busy_;
+    uint64_t total = 0;
+    for (const auto& counter : counters) {
+        total += counter.micros.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void ServerMetrics::RecordRecognitionPath(ocrservice::RecognitionPath path) {
+    if (path >= 0 && path < kNumRecognitionPaths) {
+        recognition_paths_[path].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ServerMetrics::TaskFinished(bool success) {
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    (success ? completed_ : failed_).fetch_add(1, std::memory_order_relaxed);
+}
+
+void ServerMetrics::Snapshot(ocrservice::StatsResponse* stats) const {
+    double uptime = MicrosSince(start_) / 1e6;
+    stats->set_uptime_seconds(uptime);
+    stats->set_in_flight(in_flight());
+    stats->set_requests(requests_.load(std::memory_order_relaxed));
+    stats->set_completed(completed_.load(std::memory_order_relaxed));
+    stats->set_failed(failed_.load(std::memory_order_relaxed));
+
+    for (int kind = 0; kind < kNumErrorKinds; ++kind) {
+        (*stats->mutable_errors())[kErrorNames[kind]] = errors(static_cast<ErrorKind>(kind));
+    }
+    for (int path = 0; path < kNumRecognitionPaths; ++path) {
+        (*stats->mutable_recognition_paths())[ocrservice::RecognitionPath_Name(path)] =
+            recognition_paths_[path].load(std::memory_order_relaxed);
+    }
+
+    for (int stage = 0; stage < kNumStages; ++stage) {
+        const LatencyHistogram& histogram = stages_[stage];
+        ocrservice::StageLatency* latency = stats->add_latencies();
+        latency->set_stage(kStageNames[stage]);
+        latency->set_count(histogram.count());
+        if (histogram.count() > 0) {
+            latency->set_mean_ms(ToMillis(histogram.sum()) / histogram.count());
+        }
+        latency->set_p50_ms(ToMillis(histogram.Percentile(0.50)));
+        latency->set_p90_ms(ToMillis(histogram.Percentile(0.90)));
+        latency->set_p99_ms(ToMillis(histogram.Percentile(0.99)));
+        latency->set_max_ms(ToMillis(histogram.max()));
+    }
+
+    std::vector<uint64_t> busy;
+    for (const auto& counter : decode_busy_) {
+        busy.push_back(counter.micros.load(std::memory_order_relaxed));
+    }
+    AddWorkers("decode", busy, uptime, stats);
+    busy.clear();
+    for (const auto& counter : recognition_busy_) {
+        busy.push_back(counter.micros.load(std::memory_order_relaxed));
+    }
+    AddWorkers("recognition", busy, uptime, stats);
+}
+
+// Latencies are exported as summaries (precomputed quantiles) in seconds
+std::string FormatPrometheus(const ocrservice::StatsResponse& stats) {
+    // Counters stay integers, and doubles keep every digit: the stream's
+    // default six significant digits would freeze a counter past a million
+    std::ostringstream out;
+    out << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+    auto gauge = [&out](const char* name, const char* help, auto value) {
+        out << "# HELP " << name << " " << help << "\n"
+            << "# TYPE " << name << " gauge\n"
+            << name << " " << value << "\n";
+    };
+    auto counter = [&out](const char* name, const char* help, auto value) {
+        out << "# HELP " << name << " " << help << "\n"
+            << "# TYPE " << name << " counter\n"
+            << name << " " << value << "\n";
+    };
+
+    gauge("ocr_uptime_seconds", "Seconds since the server started", stats.uptime_seconds());
+    gauge("ocr_queue_depth", "Images waiting for a decode worker", stats.queue_depth());
+    gauge("ocr_queued_bytes", "Encoded bytes waiting for a decode worker", stats.queued_bytes());
+    gauge("ocr_ready_images", "Decoded images waiting for a recognition worker",
+          stats.ready_images());
+    gauge("ocr_in_flight", "Images admitted and not yet answered", stats.in_flight());
+    gauge("ocr_recognition_workers", "Active recognition workers (autoscaled)",
+          stats.recognition_workers());
+    gauge("ocr_ready", "1 once enough engines are warm to take traffic", stats.warming_up() ? 0 : 1);
+    gauge("ocr_warm_engines", "Engines warmed at startup", stats.warm_engines());
+    gauge("ocr_startup_seconds", "Seconds from server start until ready",
+          stats.startup_seconds());
+    counter("ocr_requests_total", "Images received, including cache hits", stats.requests());
+    counter("ocr_completed_total", "Images answered successfully", stats.completed());
+    counter("ocr_failed_total", "Images answered with an error", stats.failed());
+    counter("ocr_cache_hits_total", "Result cache hits", stats.cache_hits());
+    counter("ocr_cache_misses_total", "Result cache misses", stats.cache_misses());
+
+    out << "# HELP ocr_errors_total Errors by kind\n"
+        << "# TYPE ocr_errors_total counter\n";
+    for (const auto& error : stats.errors()) {
+        out << "ocr_errors_total{kind=\"" << error.first << "\"} " << error.second << "\n";
+    }
+
+    out << "# HELP ocr_recognition_paths_total Recognized images by path (fast, full, fast then full)\n"
+        << "# TYPE ocr_recognition_paths_total counter\n";
+    for (const auto& path : stats.recognition_paths()) {
+        out << "ocr_recognition_paths_total{path=\"" << path.first << "\"} " << path.second << "\n";
+    }
+
+    out << "# HELP ocr_stage_latency_seconds Latency of each pipeline stage\n"
+        << "# TYPE ocr_stage_latency_seconds summary\n";
+    for (const auto& latency : stats.latencies()) {
+        const std::string label = "stage=\"" + latency.stage() + "\"";
+        out << "ocr_stage_latency_seconds{" << label << ",quantile=\"0.5\"} "
+            << latency.p50_ms() / 1000 << "\n"
+            << "ocr_stage_latency_seconds{" << label << ",quantile=\"0.9\"} "
+            << latency.p90_ms() / 1000 << "\n"
+            << "ocr_stage_latency_seconds{" << label << ",quantile=\"0.99\"} "
+            << latency.p99_ms() / 1000 << "\n"
+            << "ocr_stage_latency_seconds_sum{" << label << "} "
+            << latency.mean_ms() * latency.count() / 1000 << "\n"
+            << "ocr_stage_latency_seconds_count{" << label << "} "
+            << latency.count() << "\n";
+    }
+
+    out << "# HELP ocr_worker_busy_seconds_total Time each worker spent working\n"
+        << "# TYPE ocr_worker_busy_seconds_total counter\n";
+    for (const auto& worker : stats.workers()) {
+        out << "ocr_worker_busy_seconds_total{pool=\"" << worker.pool()
+            << "\",worker=\"" << worker.index() << "\"} " << worker.busy_seconds() << "\n";
+    }
+
+    return out.str();
+}
@@ -0,0 +1,120 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ocr_service.pb.h"
+
+// ============================================================================
+// MONITORING: Latency Histogram
+// ============================================================================
+// HdrHistogram-style log-linear buckets over microseconds: each power of two
+// is split into 16 linear sub-buckets, so a recorded value is reported within
+// ~6% across the full 64-bit range. Recording is a few relaxed atomic adds,
+// cheap enough for every request on every worker.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void Record(uint64_t micros);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding quantile q (0..1), capped at max()
+    uint64_t Percentile(double q) const;
+
+private:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    static int BucketFor(uint64_t value);
+    static uint64_t BucketUpperBound(int index);
+
+    std::atomic<uint64_t> buckets_[kBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+// ============================================================================
+// MONITORING: Server Metrics
+// ============================================================================
+// Lock-free counters and per-stage histograms shared by the request handlers
+// and both worker pools. Gauges the service already tracks (queue depth,
+// queued bytes, cache) are added by the service when a snapshot is taken.
+class ServerMetrics {
+public:
+    // Pipeline stages, in the order a request passes through them
+    enum Stage {
+        kReceive,      // Handler entry to enqueue (hashing, cache, admission)
+        kQueueWait,    // Waiting for a decode worker
+        kDecode,       // Leptonica decode and preprocessing
+        kReadyWait,    // Decoded, waiting for a recognition worker
+        kRecognize,    // Tesseract
+        kWrite,        // Writing a response to the stream
+        kTotal,        // Handler entry to final response
+        kNumStages
+    };
+
+    enum ErrorKind {
+        kRejected,     // Admission control turned the request away
+        kShed,         // Dropped after cancellation or deadline
+        kUnsupported,  // Input format the server cannot read
+        kDecodeError,
+        kRecognitionError,
+        kNumErrorKinds
+    };
+
+    enum Pool { kDecodePool, kRecognitionPool };
+
+    ServerMetrics(int decode_workers, int recognition_workers);
+
+    static uint64_t MicrosSince(std::chrono::steady_clock::time_point start);
+
+    void RecordStage(Stage stage, uint64_t micros) { stages_[stage].Record(micros); }
+    void RecordError(ErrorKind kind) { errors_[kind].fetch_add(1, std::memory_order_relaxed); }
+    void AddBusyTime(Pool pool, int worker, uint64_t micros);
+    uint64_t BusyMicros(Pool pool) const;  // Summed over the pool's workers
+
+    void RecordRecognitionPath(ocrservice::RecognitionPath path);
+
+    void RequestReceived() { requests_.fetch_add(1, std::memory_order_relaxed); }
+    void TaskStarted() { in_flight_.fetch_add(1, std::memory_order_relaxed); }
+    void TaskFinished(bool success);
+
+    uint64_t errors(ErrorKind kind) const { return errors_[kind].load(std::memory_order_relaxed); }
+    int in_flight() const { return in_flight_.load(std::memory_order_relaxed); }
+
+    // Fills counters, latencies and worker utilization
+    void Snapshot(ocrservice::StatsResponse* stats) const;
+
+private:
+    // One cache line per worker so busy workers don't share counters
+    struct alignas(64) BusyCounter {
+        std::atomic<uint64_t> micros{0};
+    };
+
+    std::chrono::steady_clock::time_point start_;
+    LatencyHistogram stages_[kNumStages];
+    std::atomic<uint64_t> errors_[kNumErrorKinds];
+    static constexpr int kNumRecognitionPaths = ocrservice::RecognitionPath_ARRAYSIZE;
+    std::atomic<uint64_t> recognition_paths_[kNumRecognitionPaths];
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> completed_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<int> in_flight_;
+    std::vector<BusyCounter> decode_busy_;
+    std::vector<BusyCounter> recognition_busy_;
+};
+
+// Renders a snapshot in the Prometheus text exposition format
+std::string FormatPrometheus(const ocrservice::StatsResponse& stats);
+
+#endif // METRICS_H
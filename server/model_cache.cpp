@@ -0,0 +1,85 @@
+#include "model_cache.h"
+#include "async_log.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// A read-only mapping of one whole file, unmapped when the last user lets go
+struct ModelCache::Mapping {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    ~Mapping() {
+        if (data != nullptr) {
+            ::munmap(const_cast<char*>(data), size);
+        }
+    }
+};
+
+ModelCache& ModelCache::Instance() {
+    static ModelCache cache;
+    return cache;
+}
+
+bool ModelCache::Read(const char* filename, std::vector<char>* data) {
+    std::shared_ptr<const Mapping> file = Instance().Map(filename);
+    if (!file) {
+        return false;
+    }
+    data->assign(file->data, file->data + file->size);
+    return true;
+}
+
+// Mapping is cheap (pages load on first touch), so it happens under the lock
+// and concurrent first reads of one file map it once
+std::shared_ptr<const ModelCache::Mapping> ModelCache::Map(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(filename);
+    if (it != files_.end()) {
+        return it->second;
+    }
+
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    auto file = std::make_shared<Mapping>();
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* mapping = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                               MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            OCR_LOG(LogLevel::kWarning, "Cannot map {}: {}", filename, std::strerror(errno));
+            ::close(fd);
+            return nullptr;
+        }
+        ::madvise(mapping, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+        file->data = static_cast<const char*>(mapping);
+        file->size = static_cast<size_t>(info.st_size);
+    }
+    ::close(fd);
+
+    files_.emplace(filename, file);
+    bytes_ += file->size;
+    OCR_LOG(LogLevel::kInfo, "Mapped model {} ({} MB)", filename, file->size >> 20);
+    return file;
+}
+
+void ModelCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.clear();  // Read holds a mapping only while copying it
+    bytes_ = 0;
+}
+
+size_t ModelCache::files() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return files_.size();
+}
+
+size_t ModelCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
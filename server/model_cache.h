@@ -0,0 +1,45 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ============================================================================
+// CACHING: Traineddata Mapped Once per Process
+// ============================================================================
+// TessBaseAPI::Init reads its traineddata files through a FileReader it is
+// handed. Read() is that reader: it maps each file on first use and serves
+// every later Init from the mapping, so 32 workers warming up open and read
+// the file once rather than 32 times, and a cold page cache is filled once.
+// That is all it saves. The FileReader interface hands Tesseract its own
+// std::vector, so each engine still holds a private copy of the file while
+// it parses it, and still parses it itself.
+class ModelCache {
+public:
+    static ModelCache& Instance();
+
+    // tesseract::FileReader. False when the file cannot be opened or mapped.
+    static bool Read(const char* filename, std::vector<char>* data);
+
+    // Unmaps every file. A later Read maps it again.
+    void Clear();
+
+    size_t files() const;
+    size_t bytes() const;  // Currently mapped
+
+private:
+    struct Mapping;
+
+    ModelCache() = default;
+    std::shared_ptr<const Mapping> Map(const std::string& filename);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Mapping>> files_;
+    size_t bytes_ = 0;
+};
+
+#endif // MODEL_CACHE_H
@@ -1,32 +1,336 @@
 #include "ocr_server.h"
-#include <iostream>
+#include "cpu_budget.h"
+#include "model_cache.h"
+#include <google/protobuf/arena.h>
+#include <tesseract/resultiterator.h>
+#include <cmath>
 #include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// Rows shared by neighbouring strips, so a cut never clips glyph edges
+constexpr int kBlockOverlap = 16;
+
+// Leptonica cannot rasterize PDF, so PDFs are refused with a clear error
+bool IsPdf(const ImageBuffer& image) {
+    return image.size >= 5 && std::memcmp(image.data, "%PDF-", 5) == 0;
+}
+
+// Number of pages in a TIFF (counting directories only, nothing is
+// decoded); 1 for any other format
+int CountPages(const ImageBuffer& image) {
+    bool tiff = image.size >= 4 &&
+                (std::memcmp(image.data, "II*\0", 4) == 0 ||
+                 std::memcmp(image.data, "MM\0*", 4) == 0);
+    if (!tiff) {
+        return 1;
+    }
+    FILE* file = fopenReadFromMemory(image.data, image.size);
+    if (file == nullptr) {
+        return 1;
+    }
+    l_int32 pages = 1;
+    if (tiffGetCount(file, &pages) != 0 || pages < 1) {
+        pages = 1;
+    }
+    std::fclose(file);
+    return pages;
+}
+
+// Reads the geometry of `size` bytes of pre-decoded pixels. Fails with
+// INVALID_ARGUMENT when it is malformed or does not fit the bytes sent.
+bool ParseRawImage(const ocrservice::RawImage& wire, size_t size, RawImage* raw,
+                   grpc::Status* status) {
+    auto to_int = [](uint32_t value) {
+        return static_cast<int>(std::min<uint32_t>(value, std::numeric_limits<int>::max()));
+    };
+    raw->format = static_cast<PixelFormat>(wire.format());
+    raw->width = to_int(wire.width());
+    raw->height = to_int(wire.height());
+    raw->stride = to_int(wire.stride());
+    raw->dpi = to_int(wire.dpi());
+    raw->threshold = to_int(wire.threshold());
+
+    std::string error;
+    if (!ValidateRawImage(raw, size, &error)) {
+        *status = grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error);
+        return false;
+    }
+    return true;
+}
+
+// `raw` stays kNone when the request carries an encoded file
+bool ParseRawImage(const ocrservice::ImageRequest& request, RawImage* raw,
+                   grpc::Status* status) {
+    return !request.has_raw() ||
+           ParseRawImage(request.raw(), request.image_data().size(), raw, status);
+}
+
+// Raw pixels hash their geometry too: the same bytes at another width or
+// in another format are another image
+uint64_t HashImage(const void* data, size_t size, const RawImage& raw) {
+    uint64_t hash = HashContent(data, size);
+    if (raw.format != PixelFormat::kNone) {
+        const int32_t geometry[] = {static_cast<int32_t>(raw.format), raw.width, raw.height,
+                                    raw.stride, raw.dpi, raw.threshold};
+        hash = HashCombine(hash, HashContent(geometry, sizeof(geometry)));
+    }
+    return hash;
+}
+
+int DecodeThreadCount(const ServerOptions& options) {
+    return options.decode_threads > 0 ? options.decode_threads
+                                      : std::max(1, options.num_threads / 2);
+}
+
+// First block of each worker's response arena; most responses fit in it
+constexpr size_t kResponseArenaBlockBytes = 64 * 1024;
+
+// Images narrower than this after scaling go straight to the full pass
+constexpr int kMinFastPassWidth = 400;
+
+// Downscaled copy for the fast pass, or null when the image is too small for
+// a smaller copy to be worth recognizing. pixScale also scales the resolution,
+// so Tesseract sizes glyphs correctly, and turns 1 bpp input into gray.
+PixPtr ReduceForFastPass(PIX* image, double scale) {
+    if (scale <= 0 || scale >= 1 || pixGetWidth(image) * scale < kMinFastPassWidth) {
+        return PixPtr();
+    }
+    return PixPtr(pixScale(image, static_cast<l_float32>(scale), static_cast<l_float32>(scale)));
+}
+
+// Clamps a Tesseract confidence (0-100, sometimes slightly outside) for the wire
+uint32_t ToConfidence(float confidence) {
+    return static_cast<uint32_t>(std::min(100L, std::max(0L, std::lround(confidence))));
+}
+
+// Appends a scaled box for the iterator's current element at `level`
+void AddBox(const tesseract::ResultIterator& it, tesseract::PageIteratorLevel level,
+            double scale, google::protobuf::RepeatedField<uint32_t>* boxes) {
+    int coords[4] = {0, 0, 0, 0};
+    it.BoundingBox(level, &coords[0], &coords[1], &coords[2], &coords[3]);
+    for (int coord : coords) {
+        boxes->Add(static_cast<uint32_t>(std::max(0L, std::lround(coord * scale))));
+    }
+}
+
+// Appends the words and lines of Tesseract's last recognition to `layout`
+// in reading order. `scale` maps boxes from the recognized image back to the
+// submitted one (after a downscaled fast pass). On an arena-allocated layout
+// the packed arrays and short word strings come from the arena.
+void ExtractLayout(tesseract::TessBaseAPI& engine, double scale,
+                   ocrservice::TextLayout* layout) {
+    std::unique_ptr<tesseract::ResultIterator> it(engine.GetIterator());
+    if (!it || it->Empty(tesseract::RIL_WORD)) {
+        return;
+    }
+    do {
+        if (layout->line_word_counts_size() == 0 || it->IsAtBeginningOf(tesseract::RIL_TEXTLINE)) {
+            AddBox(*it, tesseract::RIL_TEXTLINE, scale, layout->mutable_line_boxes());
+            layout->add_line_confidences(ToConfidence(it->Confidence(tesseract::RIL_TEXTLINE)));
+            layout->add_line_word_counts(0);
+        }
+        int line = layout->line_word_counts_size() - 1;
+        layout->set_line_word_counts(line, layout->line_word_counts(line) + 1);
+
+        char* word = it->GetUTF8Text(tesseract::RIL_WORD);
+        layout->add_words(word != nullptr ? word : "");
+        delete[] word;
+        AddBox(*it, tesseract::RIL_WORD, scale, layout->mutable_word_boxes());
+        layout->add_word_confidences(ToConfidence(it->Confidence(tesseract::RIL_WORD)));
+    } while (it->Next(tesseract::RIL_WORD));
+}
+
+// One Tesseract pass; false when no text could be extracted
+bool RunTesseract(tesseract::TessBaseAPI& engine, PIX* image,
+                  std::string* text, int* confidence) {
+    engine.SetImage(image);
+    char* result = engine.GetUTF8Text();
+    if (result == nullptr) {
+        return false;
+    }
+    text->assign(result);
+    delete[] result;
+    *confidence = engine.MeanTextConf();
+    return true;
+}
+
+}  // namespace
 
 // ============================================================================
 // MULTITHREADING: Thread Pool Initialization
 // ============================================================================
-// Constructor creates a pool of worker threads for concurrent image processing.
-// Each thread has its own Tesseract instance to avoid conflicts.
-OCRServiceImpl::OCRServiceImpl(int num_threads)
-    : shutdown_(false), num_threads_(num_threads) {
+// Constructor creates the two thread pools of the processing pipeline: decode
+// workers (Leptonica) and recognition workers, each with its own Tesseract
+// instance to avoid conflicts. The pools are sized independently.
+OCRServiceImpl::OCRServiceImpl(const ServerOptions& options)
+    : options_(ResolveThreadCounts(options)),
+      started_(std::chrono::steady_clock::now()),
+      decode_scheduler_(DecodeThreadCount(options_)),
+      recognition_scheduler_(options_.max_threads),
+      ready_images_(0),
+      max_ready_images_(options_.max_ready_images > 0 ? options_.max_ready_images
+                                                      : 2 * options_.max_threads),
+      shutdown_(false),
+      queued_tasks_(0), queued_bytes_(0),
+      metrics_(decode_scheduler_.num_workers(), options_.max_threads),
+      traces_(options_.trace_sample, options_.trace_buffer),
+      ready_engines_(options_.ready_engines < 0
+                         ? options_.num_threads
+                         : std::min(options_.ready_engines, options_.num_threads)),
+      engines_(options_.engine_memory_mb * 1024 * 1024),
+      default_engine_(std::make_shared<EngineConfig>()) {
+
+    // CACHING: Preprocessing and the fast pass both change what Tesseract
+    // reads, so results from different settings never share cache entries
+    // (nor do results in a cache file saved under other settings)
+    const PreprocessOptions& preprocess = options_.preprocess;
+    recognition_key_ = "|pre=" + std::to_string(preprocess.grayscale) + "," +
+                       std::to_string(preprocess.deskew) + "," +
+                       std::to_string(preprocess.binarize) + "," +
+                       std::to_string(preprocess.target_dpi);
+    if (options_.fast_pass) {
+        recognition_key_ += "|fast=" + std::to_string(options_.fast_pass_scale) + "," +
+                            std::to_string(options_.fast_pass_min_confidence) + "," +
+                            std::to_string(options_.fast_pass_oem);
+    }
+
+    // Async engine: gRPC hands ProcessImage calls to our completion queues
+    // instead of parking one sync handler thread per in-flight request
+    if (options_.async_engine) {
+        MarkMethodAsync(kProcessImageMethodIndex);
+    }
+
+    if (options_.cache_mb > 0) {
+        cache_ = std::make_unique<ResultCache>(options_.cache_mb * 1024 * 1024,
+                                               options_.cache_shards);
+        if (!options_.cache_file.empty() && cache_->Load(options_.cache_file)) {
+            OCR_LOG(LogLevel::kInfo, "Loaded {} cached results from {}", cache_->entries(),
+                    options_.cache_file);
+        }
+    }
+
+    if (ready_engines_ == 0) {
+        startup_micros_ = std::max<uint64_t>(1, ServerMetrics::MicrosSince(started_));
+    }
+
+    // MULTITHREADING: Spawn decode and recognition worker threads
+    for (int i = 0; i < decode_scheduler_.num_workers(); ++i) {
+        decode_threads_.emplace_back(&OCRServiceImpl::DecodeThread, this, i);
+    }
+    // All max_threads recognition workers exist from the start; those past
+    // the active count stand by in the scheduler until the pool grows
+    recognition_scheduler_.SetActiveWorkers(options_.num_threads);
+    for (int i = 0; i < options_.max_threads; ++i) {
+        worker_threads_.emplace_back(&OCRServiceImpl::WorkerThread, this, i);
+    }
 
-    // MULTITHREADING: Spawn worker threads (default 4)
-    for (int i = 0; i < num_threads_; ++i) {
-        worker_threads_.emplace_back(&OCRServiceImpl::WorkerThread, this);
+    if (!options_.metrics_file.empty()) {
+        metrics_thread_ = std::thread(&OCRServiceImpl::MetricsThread, this);
+    }
+    if (options_.autoscale && options_.min_threads < options_.max_threads) {
+        scaler_thread_ = std::thread(&OCRServiceImpl::ScalerThread, this);
     }
 
-    std::cout << "OCR Server initialized with " << num_threads_ << " worker threads" << std::endl;
+    if (scaler_thread_.joinable()) {
+        OCR_LOG(LogLevel::kInfo,
+                "OCR Server initialized with {} decode threads and {} worker threads "
+                "(autoscaling {}-{}), {} thread(s) per engine",
+                decode_threads_.size(), options_.num_threads, options_.min_threads,
+                options_.max_threads, options_.engine_threads);
+    } else {
+        OCR_LOG(LogLevel::kInfo,
+                "OCR Server initialized with {} decode threads and {} worker threads, "
+                "{} thread(s) per engine",
+                decode_threads_.size(), options_.num_threads, options_.engine_threads);
+    }
+    OCR_LOG(LogLevel::kDebug, "Raw pixel input uses the {} kernels",
+            PixelKernelsName(PixelKernels::kBest));
+}
+
+// The recognition pool is what the CPU budget is spent on: each worker keeps
+// engine_threads cores busy, so the budget allows CPUs / engine_threads
+// workers. Explicit values are kept, and ordered min <= num <= max.
+ServerOptions OCRServiceImpl::ResolveThreadCounts(ServerOptions options) {
+    options.engine_threads = std::max(1, options.engine_threads);
+    if (options.max_threads <= 0) {
+        // An explicit worker count above the budget still gets its workers
+        options.max_threads = std::max({1, AvailableCpus() / options.engine_threads,
+                                        options.num_threads});
+    }
+    if (options.num_threads <= 0) {
+        options.num_threads = options.max_threads;
+    }
+    if (!options.autoscale) {
+        options.min_threads = options.max_threads = options.num_threads;
+        return options;
+    }
+    options.min_threads = std::max(1, std::min(options.min_threads, options.max_threads));
+    options.num_threads = std::max(options.min_threads,
+                                   std::min(options.num_threads, options.max_threads));
+    return options;
 }
 
 OCRServiceImpl::~OCRServiceImpl() {
-    shutdown_ = true;
-    queue_cv_.notify_all();
+    Shutdown();
+}
+
+void OCRServiceImpl::Shutdown() {
+    {
+        // Under the lock so a decode thread waiting for a ready slot wakes up
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        if (shutdown_) {
+            return;
+        }
+        shutdown_ = true;
+    }
+    ready_cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+    }
+    metrics_cv_.notify_all();
+    if (metrics_thread_.joinable()) {
+        metrics_thread_.join();
+    }
+    if (scaler_thread_.joinable()) {
+        scaler_thread_.join();
+    }
 
+    // Drain the pipeline front to back: decoders first, then recognition
+    decode_scheduler_.Stop();
+    for (auto& thread : decode_threads_) {
+        thread.join();
+    }
+    recognition_scheduler_.Stop();
     for (auto& thread : worker_threads_) {
         if (thread.joinable()) {
             thread.join();
         }
     }
+    ModelCache::Instance().Clear();
+
+    OCR_LOG(LogLevel::kInfo,
+            "Admission control: {} rejected, {} shed after cancellation or deadline",
+            metrics_.errors(ServerMetrics::kRejected), metrics_.errors(ServerMetrics::kShed));
+    if (!options_.metrics_file.empty()) {
+        WriteMetricsFile();  // Final numbers, after the pipeline has drained
+    }
+    if (!options_.trace_file.empty()) {
+        WriteTraceFile();
+    }
+
+    if (cache_) {
+        OCR_LOG(LogLevel::kInfo, "Result cache: {} hits, {} misses, {} entries", cache_->hits(),
+                cache_->misses(), cache_->entries());
+        if (!options_.cache_file.empty() && !cache_->Save(options_.cache_file)) {
+            OCR_LOG(LogLevel::kError, "Failed to save result cache to {}", options_.cache_file);
+        }
+    }
 }
 
 // ============================================================================
@@ -38,122 +342,1361 @@ grpc::Status OCRServiceImpl::ProcessImage(grpc::ServerContext* context,
                                          const ocrservice::ImageRequest* request,
                                          grpc::ServerWriter<ocrservice::OCRResponse>* writer) {
 
-    std::cout << "Received image: " << request->image_id() << std::endl;
+    auto received = std::chrono::steady_clock::now();
+    metrics_.RequestReceived();
+    OCR_LOG_SAMPLED(LogLevel::kInfo, "Received image: {}", request->image_id());
 
-    // Extract binary image data from Protocol Buffer message
-    std::vector<uint8_t> image_data(request->image_data().begin(),
-                                    request->image_data().end());
+    grpc::Status invalid;
+    std::shared_ptr<const EngineConfig> engine = EngineFor(request->engine(), &invalid);
+    RawImage raw;
+    if (!engine || !ParseRawImage(*request, &raw, &invalid)) {
+        return invalid;
+    }
 
-    // SYNCHRONIZATION: Create shared synchronization primitives with proper lifetime
-    // Using shared_ptr ensures these objects live until worker thread is done
-    auto writer_mutex = std::make_shared<std::mutex>();
-    auto done_cv = std::make_shared<std::condition_variable>();
-    auto done = std::make_shared<bool>(false);
+    std::shared_ptr<RequestTrace> trace =
+        BeginTrace(*context, request->image_id(), request->image_data().size(), received);
 
-    // MULTITHREADING: Add task to queue for worker threads (Producer-Consumer pattern)
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex_);
-        task_queue_.push({request->image_id(), image_data, writer, writer_mutex, done_cv, done});
+    // CACHING: Repeated images are answered here without touching the queue
+    uint64_t cache_key =
+        CacheKey(request->image_data(), raw, *engine, request->split_blocks());
+    ocrservice::OCRResponse cached;
+    if (!request->include_layout() && LookupCached(cache_key, request->image_id(), &cached)) {
+        writer->Write(cached);
+        traces_.Finish(trace, "cached");
+        return grpc::Status::OK;
+    }
+
+    // SYNCHRONIZATION: The sink outlives the handler's wait, so the worker
+    // can always reach the writer and signal completion through it
+    // FAULT TOLERANCE: Reject immediately instead of queueing unbounded work
+    if (!Admit(request->image_data().size())) {
+        traces_.Finish(trace, "rejected");
+        return QueueFullStatus();
     }
-    queue_cv_.notify_one();  // Wake up one worker thread
+
+    auto sink = std::make_shared<StreamSink<grpc::ServerWriter<ocrservice::OCRResponse>>>(
+        context, writer);
+    sink->AddTask();
+
+    // ZERO-COPY: The task views the bytes inside the request message. gRPC keeps
+    // the request alive until this handler returns, which is after the worker
+    // is done with it, so no owner is needed.
+    OCRTask task;
+    task.image_id = request->image_id();
+    task.image = ImageBuffer::View(request->image_data());
+    task.raw = raw;
+    task.cache_key = cache_key;
+    task.deadline = context->deadline();
+    task.sink = sink;
+    task.split_blocks = request->split_blocks();
+    task.include_layout = request->include_layout();
+    task.engine = std::move(engine);
+    task.received = received;
+    task.trace = std::move(trace);
+
+    // MULTITHREADING: Add task to queue for worker threads (Producer-Consumer pattern)
+    EnqueueTask(std::move(task));
 
     // SYNCHRONIZATION: Wait for worker thread to complete processing
-    std::unique_lock<std::mutex> lock(*writer_mutex);
-    done_cv->wait(lock, [done]() {
-        return *done;  // Wait until worker sets done flag
-    });
+    sink->WaitUntilIdle();
 
     return grpc::Status::OK;
 }
 
 // ============================================================================
-// MULTITHREADING: Worker Thread Function (Producer-Consumer)
+// INTERPROCESS COMMUNICATION: Bidirectional Batch Handler
 // ============================================================================
-// Each worker thread continuously processes images from the shared queue.
-// This implements the Consumer side of the Producer-Consumer pattern.
-void OCRServiceImpl::WorkerThread() {
-    tesseract::TessBaseAPI ocr_engine;
+// One long-lived call carries many images. Every image read from the stream
+// becomes its own task, so a single client can keep all workers busy.
+// Results are written back in completion order and keyed by image_id.
+grpc::Status OCRServiceImpl::ProcessBatch(grpc::ServerContext* context,
+                                         grpc::ServerReaderWriter<ocrservice::OCRResponse,
+                                                                  ocrservice::ImageRequest>* stream) {
 
-    // Initialize Tesseract OCR engine (each thread has its own instance)
-    if (ocr_engine.Init(NULL, "eng")) {
-        std::cerr << "Could not initialize tesseract in thread "
-                  << std::this_thread::get_id() << std::endl;
-        return;
+    auto sink = std::make_shared<StreamSink<
+        grpc::ServerReaderWriter<ocrservice::OCRResponse, ocrservice::ImageRequest>>>(
+            context, stream);
+
+    // Reading and writing may overlap: workers write results while this
+    // thread keeps reading the next images off the stream. Each image is read
+    // into its own message, which the task then owns instead of copying bytes.
+    int received = 0;
+    for (;;) {
+        auto message = std::make_shared<ocrservice::ImageRequest>();
+        if (!stream->Read(message.get())) {
+            break;
+        }
+        const ocrservice::ImageRequest& request = *message;
+
+        auto received_at = std::chrono::steady_clock::now();
+        metrics_.RequestReceived();
+        OCR_LOG_SAMPLED(LogLevel::kInfo, "Received batch image: {}", request.image_id());
+
+        // A bad configuration or raw geometry fails this image only, not the stream
+        grpc::Status invalid;
+        std::shared_ptr<const EngineConfig> engine = EngineFor(request.engine(), &invalid);
+        RawImage raw;
+        if (!engine || !ParseRawImage(request, &raw, &invalid)) {
+            ocrservice::OCRResponse rejected;
+            rejected.set_image_id(request.image_id());
+            rejected.set_success(false);
+            rejected.set_error_message(invalid.error_message());
+            sink->Write(rejected);
+            ++received;
+            continue;
+        }
+
+        std::shared_ptr<RequestTrace> trace =
+            BeginTrace(*context, request.image_id(), request.image_data().size(), received_at);
+
+        uint64_t cache_key =
+            CacheKey(request.image_data(), raw, *engine, request.split_blocks());
+        ocrservice::OCRResponse cached;
+        if (!request.include_layout() &&
+            LookupCached(cache_key, request.image_id(), &cached)) {
+            sink->Write(cached);
+            traces_.Finish(trace, "cached");
+            ++received;
+            continue;
+        }
+
+        // FAULT TOLERANCE: A full queue fails this image only, not the stream
+        if (!Admit(request.image_data().size())) {
+            traces_.Finish(trace, "rejected");
+            ocrservice::OCRResponse rejected;
+            rejected.set_image_id(request.image_id());
+            rejected.set_success(false);
+            rejected.set_error_message(QueueFullStatus().error_message());
+            sink->Write(rejected);
+            ++received;
+            continue;
+        }
+
+        OCRTask task;
+        task.image_id = request.image_id();
+        task.image = ImageBuffer::View(request.image_data(), message);
+        task.raw = raw;
+        task.cache_key = cache_key;
+        task.deadline = context->deadline();
+        task.sink = sink;
+        task.split_blocks = request.split_blocks();
+        task.include_layout = request.include_layout();
+        task.engine = std::move(engine);
+        task.received = received_at;
+        task.trace = std::move(trace);
+
+        sink->AddTask();
+        EnqueueTask(std::move(task));
+        ++received;
     }
 
-    std::cout << "Worker thread " << std::this_thread::get_id()
-              << " initialized" << std::endl;
+    // SYNCHRONIZATION: Client has half-closed; wait for outstanding results
+    sink->WaitUntilIdle();
 
-    // Main worker loop: continuously process tasks from queue
-    while (!shutdown_) {
+    OCR_LOG(LogLevel::kInfo, "Batch finished: {} images", received);
+    return grpc::Status::OK;
+}
+
+// ============================================================================
+// INTERPROCESS COMMUNICATION: Chunked Upload Handler
+// ============================================================================
+// Images too large for one message arrive as a stream of chunks. Each chunk
+// is read into the same message and appended to one UploadBuffer, so the
+// image is held once, whole, by the time the client half-closes; then it
+// takes the same path as ProcessImage and results stream back on this call.
+grpc::Status OCRServiceImpl::UploadImage(grpc::ServerContext* context,
+                                        grpc::ServerReaderWriter<ocrservice::OCRResponse,
+                                                                 ocrservice::ImageChunk>* stream) {
+
+    auto received = std::chrono::steady_clock::now();
+    ocrservice::ImageChunk chunk;
+    if (!stream->Read(&chunk)) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Upload carried no image");
+    }
+    metrics_.RequestReceived();
+    const std::string image_id = chunk.image_id();
+    const bool split_blocks = chunk.split_blocks();
+    const bool include_layout = chunk.include_layout();
+    const bool has_raw = chunk.has_raw();
+    const ocrservice::RawImage raw_geometry = chunk.raw();
+    grpc::Status invalid;
+    std::shared_ptr<const EngineConfig> engine = EngineFor(chunk.engine(), &invalid);
+    if (!engine) {
+        return invalid;
+    }
+    OCR_LOG_SAMPLED(LogLevel::kInfo, "Receiving upload: {} ({} bytes declared)", image_id,
+                    chunk.total_size());
+
+    // FAULT TOLERANCE: Refuse oversized uploads before (or as soon as) the
+    // bytes exceed the cap, not after buffering all of them
+    const uint64_t max_bytes = static_cast<uint64_t>(options_.max_upload_mb) * 1024 * 1024;
+    const grpc::Status too_large(grpc::StatusCode::INVALID_ARGUMENT,
+                                 "Upload exceeds the server's " +
+                                 std::to_string(options_.max_upload_mb) + " MB limit");
+    if (max_bytes > 0 && chunk.total_size() > max_bytes) {
+        return too_large;
+    }
+
+    // FAULT TOLERANCE: An upload in flight counts against admission control
+    // from its first chunk: the declared size up front, then any bytes past
+    // it as they arrive. Every early return below gives the budget back.
+    size_t admitted = static_cast<size_t>(chunk.total_size());
+    if (!Admit(admitted)) {
+        return QueueFullStatus();
+    }
+    auto refuse = [this, &admitted](grpc::Status status) {
+        ReleaseAdmission(admitted);
+        return status;
+    };
+
+    auto upload = std::make_shared<UploadBuffer>(options_.upload_memory_mb * 1024 * 1024,
+                                                 options_.upload_spool_dir);
+    if (!upload->Reserve(chunk.total_size())) {
+        return refuse(grpc::Status(grpc::StatusCode::INTERNAL, upload->error()));
+    }
+    do {
+        size_t received_bytes = upload->size() + chunk.data().size();
+        if (max_bytes > 0 && received_bytes > max_bytes) {
+            return refuse(too_large);
+        }
+        if (received_bytes > admitted) {
+            if (!AdmitMore(received_bytes - admitted)) {
+                return refuse(QueueFullStatus());
+            }
+            admitted = received_bytes;
+        }
+        if (!upload->Append(chunk.data())) {
+            return refuse(grpc::Status(grpc::StatusCode::INTERNAL, upload->error()));
+        }
+    } while (stream->Read(&chunk));
+    if (!upload->Finish()) {
+        return refuse(grpc::Status(grpc::StatusCode::INTERNAL, upload->error()));
+    }
+    // The task holds exactly its image's bytes, as ProcessImage tasks do
+    if (admitted > upload->size()) {
+        queued_bytes_.fetch_sub(admitted - upload->size());
+        admitted = upload->size();
+    }
+    RawImage raw;
+    if (has_raw && !ParseRawImage(raw_geometry, upload->size(), &raw, &invalid)) {
+        return refuse(invalid);
+    }
+
+    // ZERO-COPY: The task views the assembled upload and keeps it alive
+    ImageBuffer image;
+    image.data = upload->data();
+    image.size = upload->size();
+    image.owner = upload;
+
+    std::shared_ptr<RequestTrace> trace = BeginTrace(*context, image_id, image.size, received);
+
+    uint64_t cache_key = CacheKey(image, raw, *engine, split_blocks);
+    ocrservice::OCRResponse cached;
+    if (!include_layout && LookupCached(cache_key, image_id, &cached)) {
+        stream->Write(cached);
+        traces_.Finish(trace, "cached");
+        return refuse(grpc::Status::OK);
+    }
+
+    auto sink = std::make_shared<StreamSink<
+        grpc::ServerReaderWriter<ocrservice::OCRResponse, ocrservice::ImageChunk>>>(
+            context, stream);
+    sink->AddTask();
+
+    OCRTask task;
+    task.image_id = image_id;
+    task.image = std::move(image);
+    task.raw = raw;
+    task.cache_key = cache_key;
+    task.deadline = context->deadline();
+    task.sink = sink;
+    task.split_blocks = split_blocks;
+    task.include_layout = include_layout;
+    task.engine = std::move(engine);
+    task.received = received;  // Receive stage covers the whole upload
+    task.trace = std::move(trace);
+    EnqueueTask(std::move(task));
+
+    sink->WaitUntilIdle();
+    return grpc::Status::OK;
+}
+
+// ============================================================================
+// CACHING: Lookup by Content Hash
+// ============================================================================
+// Lets a client ask for a result before uploading the image. Only the key
+// comes from the client; entries are always inserted under a hash the server
+// computed itself, so a wrong hash can miss but never poison the cache.
+grpc::Status OCRServiceImpl::LookupByHash(grpc::ServerContext* context,
+                                         const ocrservice::HashLookupRequest* request,
+                                         ocrservice::OCRResponse* response) {
+    grpc::Status invalid;
+    std::shared_ptr<const EngineConfig> engine = EngineFor(request->engine(), &invalid);
+    if (!engine) {
+        return invalid;
+    }
+    if (!LookupCached(CacheKey(request->content_hash(), *engine), request->image_id(), response)) {
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "No cached result for this image");
+    }
+    metrics_.RequestReceived();  // Answered in full, like any other cache hit
+    return grpc::Status::OK;
+}
+
+// Requests without engine options share one default configuration
+std::shared_ptr<const EngineConfig> OCRServiceImpl::EngineFor(
+        const ocrservice::EngineOptions& options, grpc::Status* status) const {
+    if (options.ByteSizeLong() == 0) {
+        return default_engine_;
+    }
+    auto config = std::make_shared<EngineConfig>();
+    std::string error;
+    if (!EngineConfig::FromProto(options, config.get(), &error)) {
+        *status = grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error);
+        return nullptr;
+    }
+    return config;
+}
+
+// CACHING: Results depend on the engine configuration as well as the bytes.
+// Clients hash the bytes alone, so the key is the plain content hash
+// combined with a hash of the configuration. Text merged from strips can
+// differ from a whole-page read at the seams, so split requests get their
+// own entries; LookupByHash only ever asks for whole pages.
+uint64_t OCRServiceImpl::CacheKey(uint64_t content_hash, const EngineConfig& engine,
+                                  bool split_blocks) const {
+    std::string settings = engine.Key() + recognition_key_;
+    if (split_blocks) {
+        settings += "|split=" + std::to_string(options_.block_height);
+    }
+    return HashCombine(content_hash, HashContent(settings.data(), settings.size()));
+}
+
+uint64_t OCRServiceImpl::CacheKey(const std::string& image_data, const RawImage& raw,
+                                  const EngineConfig& engine, bool split_blocks) const {
+    return CacheKey(HashImage(image_data.data(), image_data.size(), raw), engine,
+                    split_blocks);
+}
+
+uint64_t OCRServiceImpl::CacheKey(const ImageBuffer& image, const RawImage& raw,
+                                  const EngineConfig& engine, bool split_blocks) const {
+    return CacheKey(HashImage(image.data, image.size, raw), engine, split_blocks);
+}
+
+bool OCRServiceImpl::LookupCached(uint64_t key, const std::string& image_id,
+                                  ocrservice::OCRResponse* response) {
+    std::string text;
+    if (!cache_ || !cache_->Lookup(key, &text)) {
+        return false;
+    }
+
+    OCR_LOG_SAMPLED(LogLevel::kInfo, "Cache hit for image: {}", image_id);
+    response->set_image_id(image_id);
+    response->set_extracted_text(text);
+    response->set_success(true);
+    response->set_cached(true);
+    return true;
+}
+
+// ============================================================================
+// FAULT TOLERANCE: Admission Control
+// ============================================================================
+// Bounds the work waiting in the queue by count and by bytes so a burst of
+// large uploads cannot run the server out of memory. A single image larger
+// than the byte budget is still admitted when the queue is empty.
+bool OCRServiceImpl::Admit(size_t bytes) {
+    int depth = queued_tasks_.fetch_add(1) + 1;
+    size_t total = queued_bytes_.fetch_add(bytes) + bytes;
+
+    bool too_deep = options_.max_queue_depth > 0 && depth > options_.max_queue_depth;
+    bool too_big = options_.max_queued_mb > 0 && depth > 1 &&
+                   total > options_.max_queued_mb * 1024 * 1024;
+    if (too_deep || too_big) {
+        ReleaseAdmission(bytes);
+        metrics_.RecordError(ServerMetrics::kRejected);
+        return false;
+    }
+    return true;
+}
+
+// Grows an admitted task by `bytes`, as an upload's chunks arrive. The task
+// was already counted, so only the byte budget can refuse it.
+bool OCRServiceImpl::AdmitMore(size_t bytes) {
+    size_t total = queued_bytes_.fetch_add(bytes) + bytes;
+    if (options_.max_queued_mb > 0 && queued_tasks_.load() > 1 &&
+        total > options_.max_queued_mb * 1024 * 1024) {
+        queued_bytes_.fetch_sub(bytes);
+        metrics_.RecordError(ServerMetrics::kRejected);
+        return false;
+    }
+    return true;
+}
+
+void OCRServiceImpl::ReleaseAdmission(size_t bytes) {
+    queued_tasks_.fetch_sub(1);
+    queued_bytes_.fetch_sub(bytes);
+}
+
+grpc::Status OCRServiceImpl::QueueFullStatus() {
+    return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                        "Server queue is full, retry later");
+}
+
+void OCRServiceImpl::EnqueueTask(OCRTask task) {
+    task.enqueued = std::chrono::steady_clock::now();
+    metrics_.RecordStage(ServerMetrics::kReceive,
+                         ServerMetrics::MicrosSince(task.received));
+    if (task.trace) {
+        task.trace->AddSpan("receive", task.received, task.enqueued);
+    }
+    metrics_.TaskStarted();
+
+    // Lands in one decode worker's lock-free inbox; idle ones steal it if needed
+    decode_scheduler_.Submit(std::make_unique<OCRTask>(std::move(task)));
+}
+
+// ============================================================================
+// INTERPROCESS COMMUNICATION: Asynchronous ProcessImage (Completion Queue)
+// ============================================================================
+// Each AsyncImageCall is one ProcessImage call in the async engine. No thread
+// waits for it: the worker that runs the task writes the result and finishes
+// the call itself, and completion-queue threads only push queued writes
+// forward. In-flight requests are therefore bounded by memory, not threads.
+class OCRServiceImpl::AsyncImageCall final : public ResponseSink {
+public:
+    // Completion-queue tag: either one of the call's own operations or the
+    // notification gRPC delivers once the call is over (finished or cancelled)
+    struct Tag {
+        AsyncImageCall* call;
+        bool done_notification;
+    };
+
+    static void Start(OCRServiceImpl* service, grpc::ServerCompletionQueue* cq) {
+        auto call = std::make_shared<AsyncImageCall>(service, cq);
+        call->self_ = call;  // Held while completion-queue events are outstanding
+        call->context_.AsyncNotifyWhenDone(&call->done_tag_);
+        service->RequestProcessImage(&call->context_, &call->request_,
+                                     &call->writer_, cq, &call->op_tag_);
+    }
+
+    AsyncImageCall(OCRServiceImpl* service, grpc::ServerCompletionQueue* cq)
+        : service_(service), cq_(cq), writer_(&context_),
+          op_tag_{this, false}, done_tag_{this, true}, cancelled_(false) {}
+
+    // Called on a completion-queue thread for every event tagged with this call
+    void Proceed(bool ok, bool done_notification) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (done_notification) {
+            // Delivered before our Finish completes only if the call was cancelled
+            cancelled_ = context_.IsCancelled();
+            done_delivered_ = true;
+            ReleaseIfComplete(lock);
+            return;
+        }
+
+        switch (state_) {
+        case State::kAwaitingCall:
+            if (!ok) {
+                lock.unlock();
+                self_.reset();  // Queue is shutting down; no call was matched
+                return;
+            }
+            state_ = State::kStreaming;
+            lock.unlock();
+
+            // Keep accepting new calls while this one is being processed
+            Start(service_, cq_);
+            Dispatch();
+            return;
+
+        case State::kStreaming:
+            // A write completed: send the next queued response or finish
+            write_in_flight_ = false;
+            if (!ok) {
+                outbox_.clear();  // Client went away; nothing more will be delivered
+            }
+            if (!outbox_.empty()) {
+                StartWrite();
+            } else if (task_done_) {
+                StartFinish(grpc::Status::OK);
+            }
+            return;
+
+        case State::kFinishing:
+            finished_ = true;
+            ReleaseIfComplete(lock);
+            return;
+        }
+    }
+
+    void Write(const ocrservice::OCRResponse& response) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        outbox_.push_back(response);
+        if (!write_in_flight_) {
+            StartWrite();
+        }
+    }
+
+    void TaskDone() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_done_ = true;
+        if (!write_in_flight_) {
+            StartFinish(grpc::Status::OK);
+        }
+    }
+
+    bool IsCancelled() const override {
+        return cancelled_.load();
+    }
+
+private:
+    enum class State { kAwaitingCall, kStreaming, kFinishing };
+
+    void Dispatch() {
+        auto received = std::chrono::steady_clock::now();
+        service_->metrics_.RequestReceived();
+        OCR_LOG_SAMPLED(LogLevel::kInfo, "Received image: {}", request_.image_id());
+
+        grpc::Status invalid;
+        std::shared_ptr<const EngineConfig> engine =
+            service_->EngineFor(request_.engine(), &invalid);
+        RawImage raw;
+        if (!engine || !ParseRawImage(request_, &raw, &invalid)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_done_ = true;
+            StartFinish(invalid);
+            return;
+        }
+
+        std::shared_ptr<RequestTrace> trace = service_->BeginTrace(
+            context_, request_.image_id(), request_.image_data().size(), received);
+
+        uint64_t cache_key = service_->CacheKey(request_.image_data(), raw, *engine,
+                                                request_.split_blocks());
+        ocrservice::OCRResponse cached;
+        if (!request_.include_layout() &&
+            service_->LookupCached(cache_key, request_.image_id(), &cached)) {
+            Write(cached);
+            service_->traces_.Finish(trace, "cached");
+            TaskDone();
+            return;
+        }
+
+        // FAULT TOLERANCE: Reject immediately instead of queueing unbounded work
+        if (!service_->Admit(request_.image_data().size())) {
+            service_->traces_.Finish(trace, "rejected");
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_done_ = true;
+            StartFinish(OCRServiceImpl::QueueFullStatus());
+            return;
+        }
+
+        // The call owns the request, and the task keeps the call alive
         OCRTask task;
+        task.image_id = request_.image_id();
+        task.image = ImageBuffer::View(request_.image_data(), self_);
+        task.raw = raw;
+        task.cache_key = cache_key;
+        task.deadline = context_.deadline();
+        task.sink = self_;
+        task.split_blocks = request_.split_blocks();
+        task.include_layout = request_.include_layout();
+        task.engine = std::move(engine);
+        task.received = received;
+        task.trace = std::move(trace);
+        service_->EnqueueTask(std::move(task));
+    }
 
-        // SYNCHRONIZATION: Get task from queue (thread-safe)
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex_);
-            // Wait until queue has tasks or shutdown signal
-            queue_cv_.wait(lock, [this]() {
-                return !task_queue_.empty() || shutdown_;
-            });
+    // Helpers below require mutex_ to be held
+    void StartWrite() {
+        write_in_flight_ = true;
+        writer_.Write(outbox_.front(), &op_tag_);  // Serialized immediately
+        outbox_.pop_front();
+    }
+
+    void StartFinish(const grpc::Status& status) {
+        state_ = State::kFinishing;
+        writer_.Finish(status, &op_tag_);
+    }
+
+    // Drop the self-reference once gRPC will deliver no more events for us
+    void ReleaseIfComplete(std::unique_lock<std::mutex>& lock) {
+        if (!finished_ || !done_delivered_) {
+            return;
+        }
+        lock.unlock();
+        self_.reset();
+    }
+
+    OCRServiceImpl* service_;
+    grpc::ServerCompletionQueue* cq_;
+    grpc::ServerContext context_;
+    ocrservice::ImageRequest request_;
+    grpc::ServerAsyncWriter<ocrservice::OCRResponse> writer_;
+    std::shared_ptr<AsyncImageCall> self_;
+    Tag op_tag_;
+    Tag done_tag_;
+
+    std::mutex mutex_;
+    State state_ = State::kAwaitingCall;
+    std::deque<ocrservice::OCRResponse> outbox_;
+    bool write_in_flight_ = false;
+    bool task_done_ = false;
+    bool finished_ = false;
+    bool done_delivered_ = false;
+    std::atomic<bool> cancelled_;
+};
+
+void OCRServiceImpl::RequestProcessImage(grpc::ServerContext* context,
+                                         ocrservice::ImageRequest* request,
+                                         grpc::ServerAsyncWriter<ocrservice::OCRResponse>* writer,
+                                         grpc::ServerCompletionQueue* cq,
+                                         void* tag) {
+    RequestAsyncServerStreaming(kProcessImageMethodIndex, context, request, writer,
+                                cq, cq, tag);
+}
+
+void OCRServiceImpl::HandleAsyncCalls(grpc::ServerCompletionQueue* cq) {
+    AsyncImageCall::Start(this, cq);
 
-            if (shutdown_ && task_queue_.empty()) {
-                break;  // Exit if shutting down and no more tasks
+    void* tag;
+    bool ok;
+    while (cq->Next(&tag, &ok)) {
+        auto* call_tag = static_cast<AsyncImageCall::Tag*>(tag);
+        call_tag->call->Proceed(ok, call_tag->done_notification);
+    }
+}
+
+// ============================================================================
+// MULTITHREADING: Pipeline Helpers
+// ============================================================================
+// FAULT TOLERANCE: Don't spend CPU on results nobody will receive. Checked
+// at the start of both stages.
+bool OCRServiceImpl::IsStale(const OCRTask& task) {
+    return task.sink->IsCancelled() ||
+           std::chrono::system_clock::now() > task.deadline;
+}
+
+bool OCRServiceImpl::ShedIfStale(OCRTask& task) {
+    if (!IsStale(task)) {
+        return false;
+    }
+    metrics_.RecordError(ServerMetrics::kShed);
+    metrics_.TaskFinished(false);
+    OCR_LOG(LogLevel::kInfo, "Dropping stale image: {}", task.image_id);
+    traces_.Finish(task.trace, "shed");
+    task.sink->TaskDone();
+    return true;
+}
+
+void OCRServiceImpl::FailTask(OCRTask& task, ServerMetrics::ErrorKind kind,
+                              const std::string& error) {
+    metrics_.RecordError(kind);
+    ocrservice::OCRResponse response;
+    response.set_image_id(task.image_id);
+    response.set_success(false);
+    response.set_error_message(error);
+    CompleteTask(task, response);
+}
+
+void OCRServiceImpl::CompleteTask(OCRTask& task, const ocrservice::OCRResponse& response) {
+    // SYNCHRONIZATION & INTERPROCESS COMMUNICATION: Send response back to client
+    auto write_start = std::chrono::steady_clock::now();
+    task.sink->Write(response);  // gRPC streaming write (serialized by the sink)
+    metrics_.RecordStage(ServerMetrics::kWrite, ServerMetrics::MicrosSince(write_start));
+    metrics_.RecordStage(ServerMetrics::kTotal, ServerMetrics::MicrosSince(task.received));
+    metrics_.TaskFinished(response.success());
+    if (task.trace) {
+        task.trace->AddSpan("write", write_start, std::chrono::steady_clock::now());
+        traces_.Finish(task.trace, response.success() ? "ok" : "failed");
+    }
+
+    OCR_LOG_SAMPLED(LogLevel::kInfo, "Completed image: {}", task.image_id);
+    task.sink->TaskDone();  // Wake up waiting gRPC handler
+}
+
+// SYNCHRONIZATION: Bounded buffer between the stages. Decoded pages are far
+// larger than their encoded form, so decoders block here rather than run
+// ahead of Tesseract and pile up memory.
+void OCRServiceImpl::HandOffForRecognition(DecodedImage decoded) {
+    {
+        std::unique_lock<std::mutex> lock(ready_mutex_);
+        ready_cv_.wait(lock, [this]() {
+            return ready_images_ < max_ready_images_ || shutdown_;
+        });
+        ++ready_images_;
+    }
+    decoded.ready = std::chrono::steady_clock::now();
+    recognition_scheduler_.Submit(std::make_unique<DecodedImage>(std::move(decoded)));
+}
+
+// ============================================================================
+// MULTITHREADING: Intra-Document Parallelism
+// ============================================================================
+// A multi-page document, or a tall page split into strips, becomes one
+// recognition item per part, so idle workers steal the parts of a single
+// large request instead of waiting behind it. Each part streams back as soon
+// as it is recognized.
+OCRServiceImpl::OCRTask OCRServiceImpl::PartOf(const OCRTask& task) {
+    OCRTask part;
+    part.image_id = task.image_id;
+    part.cache_key = task.cache_key;
+    part.deadline = task.deadline;
+    part.sink = task.sink;
+    part.include_layout = task.include_layout;
+    part.engine = task.engine;
+    part.received = task.received;
+    part.trace = task.trace;
+    return part;
+}
+
+// A tall page is split by the recognition worker that took it, and the
+// strips go on that worker's own deque: it pops them back LIFO while idle
+// workers steal from the other end. They never wait for a ready slot, which
+// only recognition frees, and together hold no more than the page they
+// replace.
+void OCRServiceImpl::ForkBlocks(int worker_index, OCRTask task, std::vector<PixPtr> strips) {
+    auto job = std::make_shared<DocumentJob>();
+    job->texts.resize(strips.size());
+    job->remaining = static_cast<int>(strips.size());
+
+    OCR_LOG_SAMPLED(LogLevel::kInfo, "Split image {} into {} blocks", task.image_id,
+                    strips.size());
+
+    // Last strip first, so the owner's LIFO pops start at the top of the page
+    auto ready = std::chrono::steady_clock::now();
+    for (size_t i = strips.size(); i-- > 0;) {
+        auto block = std::make_unique<DecodedImage>();
+        block->task = PartOf(task);
+        block->image = std::move(strips[i]);
+        block->job = job;
+        block->part_index = static_cast<int>(i);
+        block->ready = ready;
+        block->holds_ready_slot = false;
+        recognition_scheduler_.SubmitLocal(worker_index, std::move(block));
+    }
+}
+
+// Pages are decoded one at a time and handed off as they come, so the
+// bounded ready buffer, not the page count, limits the decoded pages in memory.
+void OCRServiceImpl::DecodePages(OCRTask task, int page_count, int worker_index) {
+    auto job = std::make_shared<DocumentJob>();
+    job->by_page = true;
+    job->texts.resize(page_count);
+    job->remaining = page_count;
+
+    OCR_LOG_SAMPLED(LogLevel::kInfo, "Image {} has {} pages", task.image_id, page_count);
+
+    size_t offset = 0;  // Next page's position; reset to 0 after the last one
+    for (int page = 0; page < page_count; ++page) {
+        DecodedImage decoded;
+        decoded.task = PartOf(task);
+        decoded.job = job;
+        decoded.part_index = page;
+
+        std::string error = "Request cancelled or deadline exceeded";
+        if (!IsStale(task)) {
+            error = "Failed to decode page";
+            auto decode_start = std::chrono::steady_clock::now();
+            try {
+                PIX* image = (page == 0 || offset != 0)
+                    ? pixReadMemFromMultipageTiff(task.image.data, task.image.size, &offset)
+                    : nullptr;
+                if (image != nullptr) {
+                    decoded.image = PreprocessImage(PixPtr(image), options_.preprocess);
+                }
+            } catch (const std::exception& e) {
+                error = std::string("Exception: ") + e.what();
+            }
+            uint64_t decode_micros = ServerMetrics::MicrosSince(decode_start);
+            metrics_.RecordStage(ServerMetrics::kDecode, decode_micros);
+            metrics_.AddBusyTime(ServerMetrics::kDecodePool, worker_index, decode_micros);
+            if (task.trace) {
+                task.trace->AddSpan("decode", decode_start, std::chrono::steady_clock::now(),
+                                    RequestTrace::kDecodeLane, worker_index, page);
+            }
+            if (!decoded.image) {
+                metrics_.RecordError(ServerMetrics::kDecodeError);
             }
+        }
 
-            if (!task_queue_.empty()) {
-                task = task_queue_.front();
-                task_queue_.pop();
-            } else {
-                continue;
+        // A page that cannot be decoded still counts towards the document
+        if (!decoded.image) {
+            ocrservice::OCRResponse response;
+            response.set_image_id(task.image_id);
+            response.set_success(false);
+            response.set_error_message(error);
+            FinishPart(decoded, response);
+            continue;
+        }
+        HandOffForRecognition(std::move(decoded));
+    }
+}
+
+// Streams one part's result as a partial response. The last part of the
+// document merges the text in reading order and completes the task.
+void OCRServiceImpl::FinishPart(DecodedImage& part, ocrservice::OCRResponse& response) {
+    DocumentJob& job = *part.job;
+    OCRTask& task = part.task;
+    int part_count = static_cast<int>(job.texts.size());
+    bool stale = IsStale(task);
+
+    if (!stale) {
+        response.set_is_partial(true);
+        if (job.by_page) {
+            response.set_page_number(part.part_index + 1);
+            response.set_page_count(part_count);
+        } else {
+            response.set_block_index(part.part_index);
+            response.set_block_count(part_count);
+        }
+        auto write_start = std::chrono::steady_clock::now();
+        task.sink->Write(response);
+        metrics_.RecordStage(ServerMetrics::kWrite, ServerMetrics::MicrosSince(write_start));
+        if (task.trace) {
+            task.trace->AddSpan("write", write_start, std::chrono::steady_clock::now(),
+                                RequestTrace::kRequestLane, -1, part.part_index);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        if (response.success()) {
+            job.texts[part.part_index] = response.extracted_text();
+            job.path = std::max(job.path, response.recognition_path());
+            job.confidence_sum += response.mean_confidence();
+            if (response.recognition_path() != ocrservice::RECOGNITION_FULL) {
+                job.fast_confidence_sum += response.fast_pass_confidence();
+                ++job.fast_parts;
             }
+        } else if (job.error.empty()) {
+            job.error = job.by_page
+                ? "Page " + std::to_string(part.part_index + 1) + ": " + response.error_message()
+                : response.error_message();
+        }
+        if (--job.remaining > 0) {
+            return;
+        }
+    }
+
+    // Every other part has finished with the job; no lock needed from here
+    if (stale) {
+        metrics_.RecordError(ServerMetrics::kShed);
+        metrics_.TaskFinished(false);
+        OCR_LOG(LogLevel::kInfo, "Dropping stale image: {}", task.image_id);
+        traces_.Finish(task.trace, "shed");
+        task.sink->TaskDone();
+        return;
+    }
+
+    // Pages are separated by form feeds, as in Tesseract's own text output
+    ocrservice::OCRResponse merged;
+    merged.set_image_id(task.image_id);
+    std::string text;
+    for (int i = 0; i < part_count; ++i) {
+        if (job.by_page && i > 0) {
+            text += '\f';
+        }
+        text += job.texts[i];
+    }
+    merged.set_extracted_text(text);
+    if (job.by_page) {
+        merged.set_page_count(part_count);
+    } else {
+        merged.set_block_count(part_count);
+    }
+
+    if (job.error.empty()) {
+        merged.set_success(true);
+        merged.set_recognition_path(job.path);
+        merged.set_mean_confidence(job.confidence_sum / part_count);
+        if (job.fast_parts > 0) {
+            merged.set_fast_pass_confidence(job.fast_confidence_sum / job.fast_parts);
+        }
+        if (cache_ && !task.include_layout) {
+            cache_->Insert(task.cache_key, merged.extracted_text());
+        }
+    } else {
+        merged.set_success(false);
+        merged.set_error_message(job.error);
+    }
+    CompleteTask(task, merged);
+}
+
+void OCRServiceImpl::ReleaseReadySlot() {
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        --ready_images_;
+    }
+    ready_cv_.notify_one();
+}
+
+// ============================================================================
+// MULTITHREADING: Decode Stage (Pipeline Stage 1)
+// ============================================================================
+// Decode workers turn encoded bytes into a cleaned-up PIX (grayscale, DPI
+// normalization, deskew, binarization as configured), so the threads that own
+// a Tesseract engine spend their time on recognition only.
+void OCRServiceImpl::DecodeThread(int worker_index) {
+    for (;;) {
+        std::unique_ptr<OCRTask> next = decode_scheduler_.Next(worker_index);
+        if (!next) {
+            break;
+        }
+        OCRTask task = std::move(*next);
+        ReleaseAdmission(task.image.size);
+        metrics_.RecordStage(ServerMetrics::kQueueWait,
+                             ServerMetrics::MicrosSince(task.enqueued));
+        if (task.trace) {
+            task.trace->AddSpan("queue_wait", task.enqueued, std::chrono::steady_clock::now());
         }
 
-        std::cout << "Processing image: " << task.image_id << std::endl;
+        if (ShedIfStale(task)) {
+            continue;
+        }
 
-        // Prepare response message
-        ocrservice::OCRResponse response;
-        response.set_image_id(task.image_id);
+        // FAULT TOLERANCE: pixReadMem would silently return only the first
+        // page of a multi-page TIFF, and cannot read PDF at all
+        const bool raw = task.raw.format != PixelFormat::kNone;
+        if (!raw && IsPdf(task.image)) {
+            FailTask(task, ServerMetrics::kUnsupported,
+                     "PDF input is not supported; send pages as TIFF or images");
+            continue;
+        }
+        int page_count = raw ? 1 : CountPages(task.image);
+        if (page_count > 1) {
+            DecodePages(std::move(task), page_count, worker_index);
+            continue;
+        }
 
+        DecodedImage decoded;
+        std::string error;
+        auto decode_start = std::chrono::steady_clock::now();
         try {
-            // Decode binary image data using Leptonica
-            PIX* image = pixReadMem(task.image_data.data(), task.image_data.size());
+            // Decode binary image data using Leptonica; pre-decoded pixels
+            // go straight into a PIX with no codec in between
+            PixPtr image = raw ? ConvertRawImage(task.image.data, task.raw)
+                               : PixPtr(pixReadMem(task.image.data, task.image.size));
+            if (!image) {
+                error = "Failed to decode image";
+            } else {
+                decoded.image = PreprocessImage(std::move(image), options_.preprocess);
+            }
+        } catch (const std::exception& e) {
+            error = std::string("Exception: ") + e.what();
+        }
+        uint64_t decode_micros = ServerMetrics::MicrosSince(decode_start);
+        metrics_.RecordStage(ServerMetrics::kDecode, decode_micros);
+        metrics_.AddBusyTime(ServerMetrics::kDecodePool, worker_index, decode_micros);
+        if (task.trace) {
+            task.trace->AddSpan("decode", decode_start, std::chrono::steady_clock::now(),
+                                RequestTrace::kDecodeLane, worker_index);
+        }
+        if (!error.empty()) {
+            FailTask(task, ServerMetrics::kDecodeError, error);
+            continue;
+        }
+
+        // The encoded bytes are no longer needed; let their owner go early
+        task.image = ImageBuffer();
+
+        decoded.task = std::move(task);
+        HandOffForRecognition(std::move(decoded));
+    }
+}
+
+// ============================================================================
+// MULTITHREADING: Recognition Stage (Pipeline Stage 2, Producer-Consumer)
+// ============================================================================
+// Each worker thread takes decoded images from its own deque and inbox, and
+// steals from the other workers when those run dry.
+void OCRServiceImpl::WorkerThread(int worker_index) {
+    // Before this thread's engine starts any OpenMP parallel region
+    ApplyEngineThreads(options_.engine_threads);
 
-            if (image == nullptr) {
-                response.set_success(false);
-                response.set_error_message("Failed to decode image");
+    // Warm one default engine per initially active worker, in parallel, so
+    // the first requests don't pay for Init; it goes back to the pool for
+    // any worker to lease
+    if (worker_index < options_.num_threads) {
+        std::string error;
+        EnginePool::Lease engine = engines_.Acquire(*default_engine_, &error);
+        if (!engine) {
+            // Keeps serving: each task retries Init and reports its own error
+            OCR_LOG(LogLevel::kError, "Could not initialize tesseract in worker {}: {}",
+                    worker_index, error);
+        }
+        EngineWarmed(static_cast<bool>(engine));
+    }
+
+    OCR_LOG(LogLevel::kInfo, "Worker thread {} initialized", worker_index);
+
+    // Responses are built on a per-worker arena and freed all at once before
+    // the next task, so a layout with thousands of words costs no per-word
+    // heap allocations. Sinks serialize or copy a response before returning.
+    google::protobuf::ArenaOptions arena_options;
+    arena_options.start_block_size = kResponseArenaBlockBytes;
+    google::protobuf::Arena arena(arena_options);
+
+    // Main worker loop: continuously process decoded images from the scheduler
+    for (;;) {
+        // SYNCHRONIZATION: Own deque and inbox first, then steal from others.
+        // Blocks while idle; returns nullptr once shut down and drained.
+        std::unique_ptr<DecodedImage> next = recognition_scheduler_.Next(worker_index);
+        if (!next) {
+            break;
+        }
+        arena.Reset();
+        if (next->holds_ready_slot) {
+            ReleaseReadySlot();
+        }
+        OCRTask& task = next->task;
+        metrics_.RecordStage(ServerMetrics::kReadyWait,
+                             ServerMetrics::MicrosSince(next->ready));
+        if (task.trace) {
+            task.trace->AddSpan("ready_wait", next->ready, std::chrono::steady_clock::now(),
+                                RequestTrace::kRequestLane, -1,
+                                next->job ? next->part_index : -1);
+        }
+
+        // Parts of a document are never shed one by one: the document
+        // completes once, when its last part is done
+        if (next->job) {
+            auto* response =
+                google::protobuf::Arena::CreateMessage<ocrservice::OCRResponse>(&arena);
+            if (IsStale(task)) {
+                response->set_image_id(task.image_id);
+                response->set_success(false);
+                response->set_error_message("Request cancelled or deadline exceeded");
             } else {
-                // Perform OCR using Tesseract
-                ocr_engine.SetImage(image);
-                char* text = ocr_engine.GetUTF8Text();
-
-                if (text != nullptr) {
-                    response.set_extracted_text(text);
-                    response.set_success(true);
-                    delete[] text;
-                } else {
-                    response.set_success(false);
-                    response.set_error_message("Failed to extract text");
+                Recognize(worker_index, task, next->image.get(), response);
+            }
+            next->image.reset();
+            FinishPart(*next, *response);
+            continue;
+        }
+
+        if (ShedIfStale(task)) {
+            continue;
+        }
+
+        // Layout requests keep the page whole so boxes stay in page coordinates
+        if (task.split_blocks && !task.include_layout) {
+            std::vector<PixPtr> strips = SplitIntoStrips(
+                next->image.get(), options_.block_height, kBlockOverlap);
+            if (strips.size() > 1) {
+                next->image.reset();
+                ForkBlocks(worker_index, std::move(task), std::move(strips));
+                continue;
+            }
+        }
+
+        auto* response = google::protobuf::Arena::CreateMessage<ocrservice::OCRResponse>(&arena);
+        Recognize(worker_index, task, next->image.get(), response);
+        next->image.reset();  // Clean up image memory
+
+        // The cache holds text only, so layout results are never cached
+        if (response->success() && cache_ && !task.include_layout) {
+            cache_->Insert(task.cache_key, response->extracted_text());
+        }
+        CompleteTask(task, *response);
+    }
+}
+
+void OCRServiceImpl::Recognize(int worker_index, const OCRTask& task, PIX* image,
+                               ocrservice::OCRResponse* response) {
+    OCR_LOG_SAMPLED(LogLevel::kInfo, "Processing image: {}", task.image_id);
+    auto start = std::chrono::steady_clock::now();
+
+    response->set_image_id(task.image_id);
+
+    // MULTITHREADING: Exclusive use of an engine configured for this request,
+    // usually already initialized; returned to the pool on scope exit
+    std::string error;
+    EnginePool::Lease ocr_engine = engines_.Acquire(*task.engine, &error);
+
+    try {
+        if (!ocr_engine) {
+            response->set_success(false);
+            response->set_error_message(error);
+        } else {
+            std::string text;
+            int confidence = 0;
+            ocrservice::RecognitionPath path = ocrservice::RECOGNITION_FULL;
+
+            // Adaptive two-pass recognition: clean images are read well
+            // enough from a downscaled copy; only those Tesseract is unsure
+            // about pay for the full-resolution pass
+            PixPtr reduced = options_.fast_pass
+                ? ReduceForFastPass(image, options_.fast_pass_scale) : PixPtr();
+            if (reduced) {
+                EnginePool::Lease fast_engine;
+                if (options_.fast_pass_oem >= 0 &&
+                    options_.fast_pass_oem != task.engine->engine_mode) {
+                    EngineConfig fast_config = *task.engine;
+                    fast_config.engine_mode = options_.fast_pass_oem;
+                    std::string fast_error;
+                    fast_engine = engines_.Acquire(fast_config, &fast_error);
                 }
+                tesseract::TessBaseAPI& fast = fast_engine ? *fast_engine : *ocr_engine;
 
-                pixDestroy(&image);  // Clean up image memory
+                int fast_confidence = 0;
+                path = ocrservice::RECOGNITION_FAST_THEN_FULL;
+                if (RunTesseract(fast, reduced.get(), &text, &fast_confidence)) {
+                    response->set_fast_pass_confidence(fast_confidence);
+                    if (fast_confidence >= options_.fast_pass_min_confidence) {
+                        path = ocrservice::RECOGNITION_FAST;
+                        confidence = fast_confidence;
+                        if (task.include_layout) {
+                            double box_scale = static_cast<double>(pixGetWidth(image)) /
+                                               pixGetWidth(reduced.get());
+                            ExtractLayout(fast, box_scale, response->mutable_layout());
+                        }
+                    }
+                }
+                reduced.reset();
+            }
+
+            bool recognized = path == ocrservice::RECOGNITION_FAST;
+            if (!recognized) {
+                recognized = RunTesseract(*ocr_engine, image, &text, &confidence);
+                if (recognized && task.include_layout) {
+                    ExtractLayout(*ocr_engine, 1.0, response->mutable_layout());
+                }
+            }
+
+            if (!recognized) {
+                response->set_success(false);
+                response->set_error_message("Failed to extract text");
+            } else {
+                response->set_extracted_text(text);
+                response->set_success(true);
+                response->set_recognition_path(path);
+                response->set_mean_confidence(confidence);
+                metrics_.RecordRecognitionPath(path);
             }
-        } catch (const std::exception& e) {
-            response.set_success(false);
-            response.set_error_message(std::string("Exception: ") + e.what());
         }
+    } catch (const std::exception& e) {
+        response->set_success(false);
+        response->set_error_message(std::string("Exception: ") + e.what());
+    }
+
+    uint64_t micros = ServerMetrics::MicrosSince(start);
+    metrics_.RecordStage(ServerMetrics::kRecognize, micros);
+    metrics_.AddBusyTime(ServerMetrics::kRecognitionPool, worker_index, micros);
+    if (task.trace) {
+        task.trace->AddSpan("recognize", start, std::chrono::steady_clock::now(),
+                            RequestTrace::kRecognitionLane, worker_index);
+    }
+    if (!response->success()) {
+        metrics_.RecordError(ServerMetrics::kRecognitionError);
+    }
+}
+
+// ============================================================================
+// MONITORING: Statistics
+// ============================================================================
+grpc::Status OCRServiceImpl::GetStats(grpc::ServerContext* context,
+                                     const ocrservice::StatsRequest* request,
+                                     ocrservice::StatsResponse* response) {
+    CollectStats(response);
+    return grpc::Status::OK;
+}
+
+// ============================================================================
+// MONITORING: Request Traces
+// ============================================================================
+grpc::Status OCRServiceImpl::GetTrace(grpc::ServerContext* context,
+                                     const ocrservice::TraceRequest* request,
+                                     ocrservice::TraceResponse* response) {
+    std::string events;
+    response->set_requests(traces_.Export(request->trace_id(), request->clear(), &events));
+    response->set_trace_events(std::move(events));
+    return grpc::Status::OK;
+}
 
-        // SYNCHRONIZATION & INTERPROCESS COMMUNICATION: Send response back to client
+// The client's trace context arrives as W3C "traceparent" metadata
+std::shared_ptr<RequestTrace> OCRServiceImpl::BeginTrace(
+        const grpc::ServerContext& context, const std::string& image_id, size_t image_bytes,
+        std::chrono::steady_clock::time_point received) {
+    TraceContext client;
+    const auto& metadata = context.client_metadata();
+    auto it = metadata.find(kTraceParentKey);
+    if (it != metadata.end()) {
+        TraceContext::FromTraceParent(std::string(it->second.data(), it->second.size()),
+                                      &client);
+    }
+    return traces_.Begin(client, image_id, image_bytes, received);
+}
+
+// Opens in Perfetto (ui.perfetto.dev) or chrome://tracing
+void OCRServiceImpl::WriteTraceFile() {
+    std::string events;
+    int requests = traces_.Export(std::string(), false, &events);
+
+    std::string tmp_path = options_.trace_file + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        file << "{\"traceEvents\":[\n" << events << "\n]}\n";
+        if (!file) {
+            OCR_LOG(LogLevel::kError, "Failed to write traces to {}", tmp_path);
+            return;
+        }
+    }
+    std::rename(tmp_path.c_str(), options_.trace_file.c_str());
+    OCR_LOG(LogLevel::kInfo, "Wrote {} traced requests to {}", requests, options_.trace_file);
+}
+
+// ============================================================================
+// MONITORING: Readiness
+// ============================================================================
+// Until enough engines are warm, requests would queue behind Tesseract Init,
+// so the health service keeps reporting NOT_SERVING
+// FAULT TOLERANCE: A worker whose engine failed to warm lowers the target to
+// what can still be reached, so one bad Init cannot hold the server in
+// NOT_SERVING forever. If no engine warms at all it never becomes ready.
+void OCRServiceImpl::EngineWarmed(bool warmed) {
+    uint64_t startup_micros;
+    int warm_engines;
+    {
+        std::lock_guard<std::mutex> lock(warm_mutex_);
+        if (warmed) {
+            ++warm_engines_;
+        } else {
+            ++warm_failures_;
+        }
+        int target = std::min(ready_engines_, options_.num_threads - warm_failures_);
+        if (startup_micros_ > 0 || warm_engines_ < target) {
+            return;
+        }
+        if (warm_engines_ == 0) {
+            if (warm_failures_ == options_.num_threads) {
+                OCR_LOG(LogLevel::kError,
+                        "No tesseract engine could be initialized; staying NOT_SERVING");
+            }
+            return;
+        }
+        warm_engines = warm_engines_;
+        startup_micros = std::max<uint64_t>(1, ServerMetrics::MicrosSince(started_));
+        startup_micros_ = startup_micros;
+    }
+    warm_cv_.notify_all();
+    OCR_LOG(LogLevel::kInfo, "Ready: {} engines warm {} ms after start ({} MB of models mapped)",
+            warm_engines, startup_micros / 1000, ModelCache::Instance().bytes() >> 20);
+}
+
+bool OCRServiceImpl::WaitUntilReady(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(warm_mutex_);
+    return warm_cv_.wait_for(lock, timeout, [this]() { return startup_micros_ > 0; });
+}
+
+void OCRServiceImpl::CollectStats(ocrservice::StatsResponse* stats) {
+    metrics_.Snapshot(stats);
+    stats->set_queue_depth(queued_tasks_.load());
+    stats->set_queued_bytes(queued_bytes_.load());
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        stats->set_ready_images(ready_images_);
+    }
+    stats->set_recognition_workers(recognition_scheduler_.active_workers());
+    {
+        std::lock_guard<std::mutex> lock(warm_mutex_);
+        stats->set_warm_engines(warm_engines_);
+    }
+    uint64_t startup_micros = startup_micros_.load();
+    stats->set_warming_up(startup_micros == 0);
+    stats->set_startup_seconds(startup_micros / 1e6);
+    if (cache_) {
+        stats->set_cache_hits(cache_->hits());
+        stats->set_cache_misses(cache_->misses());
+    }
+}
+
+// Written to a temporary file and renamed, so a scraper (e.g. the node
+// exporter's textfile collector) never reads a half-written file
+void OCRServiceImpl::WriteMetricsFile() {
+    ocrservice::StatsResponse stats;
+    CollectStats(&stats);
+
+    std::string tmp_path = options_.metrics_file + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        file << FormatPrometheus(stats);
+        if (!file) {
+            OCR_LOG(LogLevel::kError, "Failed to write metrics to {}", tmp_path);
+            return;
+        }
+    }
+    std::rename(tmp_path.c_str(), options_.metrics_file.c_str());
+}
+
+// ============================================================================
+// MULTITHREADING: Recognition Pool Autoscaling
+// ============================================================================
+// Every interval, compares the recognition workers' busy time with the time
+// the active workers had. The pool grows by one while decoded images wait
+// and the workers are nearly saturated, and shrinks by one after several
+// quiet intervals, so short lulls don't make it flap. Growing never costs a
+// thread start: the worker already exists and only stops standing by.
+void OCRServiceImpl::ScalerThread() {
+    constexpr double kGrowUtilization = 0.85;
+    constexpr double kShrinkUtilization = 0.40;
+    constexpr int kQuietIntervalsToShrink = 5;
+
+    auto interval = std::chrono::milliseconds(options_.autoscale_interval_ms);
+    uint64_t last_busy = metrics_.BusyMicros(ServerMetrics::kRecognitionPool);
+    auto last_time = std::chrono::steady_clock::now();
+    int quiet_intervals = 0;
+
+    std::unique_lock<std::mutex> lock(metrics_mutex_);
+    while (!shutdown_) {
+        metrics_cv_.wait_for(lock, interval, [this]() { return shutdown_.load(); });
+        if (shutdown_) {
+            break;
+        }
+
+        uint64_t busy = metrics_.BusyMicros(ServerMetrics::kRecognitionPool);
+        auto now = std::chrono::steady_clock::now();
+        int active = recognition_scheduler_.active_workers();
+        double elapsed = std::chrono::duration<double, std::micro>(now - last_time).count();
+        double utilization = elapsed > 0 ? (busy - last_busy) / (elapsed * active) : 0;
+        last_busy = busy;
+        last_time = now;
+
+        int waiting;
         {
-            std::lock_guard<std::mutex> lock(*task.writer_mutex);
-            task.writer->Write(response);  // gRPC streaming write
-            *task.done = true;  // Mark task as complete
+            std::lock_guard<std::mutex> ready_lock(ready_mutex_);
+            waiting = ready_images_;
+        }
+
+        int target = active;
+        if (waiting > 0 && utilization >= kGrowUtilization) {
+            quiet_intervals = 0;
+            target = std::min(active + 1, options_.max_threads);
+        } else if (waiting == 0 && utilization < kShrinkUtilization) {
+            if (++quiet_intervals >= kQuietIntervalsToShrink) {
+                quiet_intervals = 0;
+                target = std::max(active - 1, options_.min_threads);
+            }
+        } else {
+            quiet_intervals = 0;
         }
 
-        std::cout << "Completed image: " << task.image_id << std::endl;
-        task.done_cv->notify_one();  // Wake up waiting gRPC handler
+        if (target != active) {
+            recognition_scheduler_.SetActiveWorkers(target);
+            OCR_LOG(LogLevel::kInfo, "Recognition pool: {} -> {} workers ({}% busy, {} waiting)",
+                    active, target, static_cast<int>(utilization * 100), waiting);
+        }
     }
+}
 
-    ocr_engine.End();  // Cleanup Tesseract
+void OCRServiceImpl::MetricsThread() {
+    std::unique_lock<std::mutex> lock(metrics_mutex_);
+    while (!shutdown_) {
+        metrics_cv_.wait_for(lock, std::chrono::milliseconds(options_.metrics_interval_ms),
+                             [this]() { return shutdown_.load(); });
+        if (!shutdown_) {
+            WriteMetricsFile();
+        }
+    }
 }
 
 std::string OCRServiceImpl::PerformOCR(const std::vector<uint8_t>& image_data) {
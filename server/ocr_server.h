@@ -5,41 +5,322 @@
 #include <tesseract/baseapi.h>
 #include <leptonica/allheaders.h>
 #include <thread>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <memory>
 #include <atomic>
+#include <chrono>
+#include <vector>
 #include "ocr_service.grpc.pb.h"
+#include "async_log.h"
+#include "engine_pool.h"
+#include "image_preprocess.h"
+#include "metrics.h"
+#include "raw_image.h"
+#include "request_trace.h"
+#include "result_cache.h"
+#include "task_scheduler.h"
+#include "upload_buffer.h"
+
+// Non-owning view of encoded image bytes. `owner` keeps the underlying buffer
+// (usually the request message) alive; it may be empty when the caller
+// guarantees the bytes outlive the task, as a blocked sync handler does.
+struct ImageBuffer {
+    std::shared_ptr<const void> owner;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    static ImageBuffer View(const std::string& bytes,
+                            std::shared_ptr<const void> owner = nullptr) {
+        ImageBuffer buffer;
+        buffer.owner = std::move(owner);
+        buffer.data = reinterpret_cast<const uint8_t*>(bytes.data());
+        buffer.size = bytes.size();
+        return buffer;
+    }
+};
+
+// Destination for the results of one gRPC call. Workers write every result
+// through the sink and call TaskDone() once per task they were handed.
+class ResponseSink {
+public:
+    virtual ~ResponseSink() = default;
+    virtual void Write(const ocrservice::OCRResponse& response) = 0;
+    virtual void TaskDone() = 0;
+    // True once the client has gone away; queued work for it can be dropped
+    virtual bool IsCancelled() const = 0;
+};
+
+// Sink for a synchronous handler. One call may own several tasks
+// (ProcessBatch), so the handler counts them in and waits until idle.
+template <typename Writer>
+class StreamSink final : public ResponseSink {
+public:
+    StreamSink(grpc::ServerContext* context, Writer* writer)
+        : context_(context), writer_(writer) {}
+
+    void AddTask() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+    }
+
+    void Write(const ocrservice::OCRResponse& response) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writer_->Write(response);
+    }
+
+    void TaskDone() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --pending_;
+        }
+        done_cv_.notify_all();
+    }
+
+    bool IsCancelled() const override {
+        return context_->IsCancelled();
+    }
+
+    void WaitUntilIdle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return pending_ == 0; });
+    }
+
+private:
+    grpc::ServerContext* context_;
+    Writer* writer_;
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    int pending_ = 0;
+};
+
+// Runtime configuration, filled in from the command line by main.cpp.
+struct ServerOptions {
+    int num_threads = 0;        // Initial Tesseract (recognition) workers; 0 = max_threads
+    int min_threads = 1;        // Autoscaling bounds for the recognition pool;
+    int max_threads = 0;        // 0 = available CPUs / engine_threads
+    bool autoscale = true;      // Grow and shrink the recognition pool with load
+    int autoscale_interval_ms = 1000;
+    int engine_threads = 1;     // OpenMP threads inside each Tesseract engine
+    int decode_threads = 0;     // Decode/preprocess threads; 0 = half of num_threads
+    int max_ready_images = 0;   // Decoded images waiting for Tesseract; 0 = 2 x max_threads
+    PreprocessOptions preprocess;
+    int block_height = 1000;    // Strip height for split_blocks requests, in pixels
+    bool async_engine = false;  // Serve ProcessImage from completion queues
+    int cq_threads = 2;         // Completion-queue polling threads (async only)
+    size_t cache_mb = 64;       // Result cache budget; 0 disables the cache
+    int cache_shards = 16;
+    std::string cache_file;     // Optional persistence file for the cache
+    int max_queue_depth = 256;  // Admission limits; 0 means unlimited
+    size_t max_queued_mb = 1024;
+    std::string metrics_file;   // Prometheus text dump, rewritten periodically
+    int metrics_interval_ms = 5000;
+    size_t upload_memory_mb = 64;   // Larger UploadImage streams spool to a temp file
+    size_t max_upload_mb = 2048;    // Per-upload cap; 0 means unlimited
+    std::string upload_spool_dir;   // Empty means $TMPDIR or /tmp
+    size_t engine_memory_mb = 1024; // Idle Tesseract engines are evicted past this
+    bool fast_pass = false;         // Recognize a downscaled copy first (see Recognize)
+    double fast_pass_scale = 0.5;   // Linear scale of the fast-pass image
+    int fast_pass_min_confidence = 75;  // Below this MeanTextConf, redo at full resolution
+    int fast_pass_oem = -1;         // Engine mode for the fast pass; -1 keeps the request's
+    LogOptions log;                 // Started by main, before the service exists
+    uint32_t trace_sample = 0;      // Also trace 1 in N requests the client didn't sample; 0 = none
+    size_t trace_buffer = 1000;     // Finished traces kept for GetTrace; 0 disables tracing
+    std::string trace_file;         // Chrome trace JSON of the kept traces, written at shutdown
+    int ready_engines = -1;         // Warm engines before reporting ready; -1 = num_threads
+};
 
 class OCRServiceImpl final : public ocrservice::OCRService::Service {
 public:
-    OCRServiceImpl(int num_threads = 4);
+    explicit OCRServiceImpl(const ServerOptions& options = ServerOptions());
     ~OCRServiceImpl();
 
     grpc::Status ProcessImage(grpc::ServerContext* context,
                              const ocrservice::ImageRequest* request,
                              grpc::ServerWriter<ocrservice::OCRResponse>* writer) override;
 
+    grpc::Status ProcessBatch(grpc::ServerContext* context,
+                             grpc::ServerReaderWriter<ocrservice::OCRResponse,
+                                                      ocrservice::ImageRequest>* stream) override;
+
+    grpc::Status GetStats(grpc::ServerContext* context,
+                         const ocrservice::StatsRequest* request,
+                         ocrservice::StatsResponse* response) override;
+
+    grpc::Status UploadImage(grpc::ServerContext* context,
+                            grpc::ServerReaderWriter<ocrservice::OCRResponse,
+                                                     ocrservice::ImageChunk>* stream) override;
+
+    grpc::Status LookupByHash(grpc::ServerContext* context,
+                             const ocrservice::HashLookupRequest* request,
+                             ocrservice::OCRResponse* response) override;
+
+    grpc::Status GetTrace(grpc::ServerContext* context,
+                         const ocrservice::TraceRequest* request,
+                         ocrservice::TraceResponse* response) override;
+
+    // Drives asynchronous ProcessImage calls on one completion queue until it
+    // is shut down. Only valid when the service was built with async_engine.
+    void HandleAsyncCalls(grpc::ServerCompletionQueue* cq);
+
+    // MONITORING: True once ready_engines default engines are warm, waiting
+    // up to `timeout` for that. RunServer's health status follows it.
+    bool WaitUntilReady(std::chrono::milliseconds timeout);
+
+    // FAULT TOLERANCE: Drains and joins both pipeline stages, then writes the
+    // final metrics, traces and result cache. Every queued task has reported
+    // to its sink when this returns, so in async mode it must run before the
+    // completion queues shut down. Idempotent; the destructor calls it too.
+    void Shutdown();
+
 private:
+    class AsyncImageCall;
+
+    // Thread counts left at 0 filled in from the CPU budget
+    static ServerOptions ResolveThreadCounts(ServerOptions options);
+
+    // First, so every other member can be initialized from resolved options
+    ServerOptions options_;
+    const std::chrono::steady_clock::time_point started_;  // Startup is timed from here
+
+    // RPC index used by the async API; follows declaration order in ocr_service.proto
+    static constexpr int kProcessImageMethodIndex = 0;
+
+    // Move-only: the image bytes are never copied on their way to Leptonica
     struct OCRTask {
+        OCRTask() = default;
+        OCRTask(OCRTask&&) = default;
+        OCRTask& operator=(OCRTask&&) = default;
+        OCRTask(const OCRTask&) = delete;
+        OCRTask& operator=(const OCRTask&) = delete;
+
         std::string image_id;
-        std::vector<uint8_t> image_data;
-        grpc::ServerWriter<ocrservice::OCRResponse>* writer;
-        std::shared_ptr<std::mutex> writer_mutex;
-        std::shared_ptr<std::condition_variable> done_cv;
-        std::shared_ptr<bool> done;
+        ImageBuffer image;
+        RawImage raw;                 // Geometry when `image` holds pixels, not a file
+        uint64_t cache_key = 0;
+        std::chrono::system_clock::time_point deadline =
+            std::chrono::system_clock::time_point::max();
+        std::shared_ptr<ResponseSink> sink;
+        bool split_blocks = false;
+        bool include_layout = false;  // Never cached or split into blocks
+        std::shared_ptr<const EngineConfig> engine;      // Never null
+        std::chrono::steady_clock::time_point received;  // Handler entry
+        std::chrono::steady_clock::time_point enqueued;
+        std::shared_ptr<RequestTrace> trace;             // Null unless traced
     };
 
-    void WorkerThread();
+    // Shared by the parts of one document: the pages of a multi-page TIFF or
+    // the blocks of a split page. The last part to finish writes the merged
+    // result and completes the task.
+    struct DocumentJob {
+        std::mutex mutex;
+        bool by_page = false;            // Parts are pages rather than blocks
+        std::vector<std::string> texts;  // In reading order
+        int remaining = 0;
+        std::string error;               // First part failure, if any
+        ocrservice::RecognitionPath path = ocrservice::RECOGNITION_FULL;  // Costliest part
+        int confidence_sum = 0;          // Averaged over parts in the merged result
+        int fast_confidence_sum = 0;
+        int fast_parts = 0;              // Parts that ran a fast pass
+    };
+
+    // Output of the decode stage, waiting for a Tesseract worker. Parts of a
+    // document carry their job and position; whole images have no job.
+    struct DecodedImage {
+        OCRTask task;
+        PixPtr image;
+        std::shared_ptr<DocumentJob> job;
+        int part_index = 0;
+        std::chrono::steady_clock::time_point ready;  // Handed to recognition
+        bool holds_ready_slot = true;  // False for strips a worker forked itself
+    };
+
+    bool Admit(size_t bytes);
+    bool AdmitMore(size_t bytes);
+    void ReleaseAdmission(size_t bytes);
+    static grpc::Status QueueFullStatus();
+    void EnqueueTask(OCRTask task);
+    std::shared_ptr<const EngineConfig> EngineFor(const ocrservice::EngineOptions& options,
+                                                  grpc::Status* status) const;
+    uint64_t CacheKey(uint64_t content_hash, const EngineConfig& engine,
+                      bool split_blocks = false) const;
+    uint64_t CacheKey(const std::string& image_data, const RawImage& raw,
+                      const EngineConfig& engine, bool split_blocks) const;
+    uint64_t CacheKey(const ImageBuffer& image, const RawImage& raw,
+                      const EngineConfig& engine, bool split_blocks) const;
+    bool LookupCached(uint64_t key, const std::string& image_id,
+                      ocrservice::OCRResponse* response);
+    std::shared_ptr<RequestTrace> BeginTrace(const grpc::ServerContext& context,
+                                             const std::string& image_id, size_t image_bytes,
+                                             std::chrono::steady_clock::time_point received);
+    void WriteTraceFile();
+    void RequestProcessImage(grpc::ServerContext* context,
+                             ocrservice::ImageRequest* request,
+                             grpc::ServerAsyncWriter<ocrservice::OCRResponse>* writer,
+                             grpc::ServerCompletionQueue* cq,
+                             void* tag);
+    static bool IsStale(const OCRTask& task);
+    bool ShedIfStale(OCRTask& task);
+    void FailTask(OCRTask& task, ServerMetrics::ErrorKind kind, const std::string& error);
+    void CompleteTask(OCRTask& task, const ocrservice::OCRResponse& response);
+    void HandOffForRecognition(DecodedImage decoded);
+    void ForkBlocks(int worker_index, OCRTask task, std::vector<PixPtr> strips);
+    void DecodePages(OCRTask task, int page_count, int worker_index);
+    static OCRTask PartOf(const OCRTask& task);
+    void FinishPart(DecodedImage& part, ocrservice::OCRResponse& response);
+    void Recognize(int worker_index, const OCRTask& task, PIX* image,
+                   ocrservice::OCRResponse* response);
+    void ReleaseReadySlot();
+    void DecodeThread(int worker_index);
+    void WorkerThread(int worker_index);
+    void EngineWarmed(bool warmed);
+    void CollectStats(ocrservice::StatsResponse* stats);
+    void WriteMetricsFile();
+    void MetricsThread();
+    void ScalerThread();
     std::string PerformOCR(const std::vector<uint8_t>& image_data);
 
+    // Two-stage pipeline: decode pool -> bounded buffer -> recognition pool
+    std::vector<std::thread> decode_threads_;
     std::vector<std::thread> worker_threads_;
-    std::queue<OCRTask> task_queue_;
-    std::mutex queue_mutex_;
-    std::condition_variable queue_cv_;
+    WorkStealingScheduler<OCRTask> decode_scheduler_;
+    WorkStealingScheduler<DecodedImage> recognition_scheduler_;
+    std::mutex ready_mutex_;
+    std::condition_variable ready_cv_;
+    int ready_images_;
+    int max_ready_images_;
     std::atomic<bool> shutdown_;
-    int num_threads_;
+
+    // Admission control: work waiting in the queue
+    std::atomic<int> queued_tasks_;
+    std::atomic<size_t> queued_bytes_;
+
+    // MONITORING: Counters and latencies behind GetStats and the metrics file
+    ServerMetrics metrics_;
+    TraceRecorder traces_;
+    std::thread metrics_thread_;
+    std::mutex metrics_mutex_;
+    std::condition_variable metrics_cv_;
+
+    // MULTITHREADING: Autoscaler for the recognition pool, which starts
+    // max_threads workers and keeps only the active ones taking work
+    std::thread scaler_thread_;
+
+    // MONITORING: Readiness. Initially active workers each warm one default
+    // engine in parallel; the server is ready once ready_engines_ are warm.
+    int ready_engines_;
+    std::mutex warm_mutex_;
+    std::condition_variable warm_cv_;
+    int warm_engines_ = 0;
+    int warm_failures_ = 0;
+    std::atomic<uint64_t> startup_micros_{0};  // Start until ready; 0 before
+
+    // Initialized Tesseract engines, leased per recognition
+    EnginePool engines_;
+    std::shared_ptr<const EngineConfig> default_engine_;
+    std::string recognition_key_;  // Fast-pass settings, folded into cache keys
+
+    std::unique_ptr<ResultCache> cache_;
 };
 
 #endif // OCR_SERVER_H
@@ -0,0 +1,367 @@
+#include "raw_image.h"
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OCR_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Tesseract keeps image coordinates in 16-bit integers
+constexpr int kMaxRawSide = 32767;
+
+// Leptonica's luminance weights (0.3, 0.5, 0.2) in 8-bit fixed point; they
+// sum to 256, so white stays 255
+constexpr int kRedWeight = 77;
+constexpr int kGreenWeight = 128;
+constexpr int kBlueWeight = 51;
+
+// Byte offsets of the color channels within a pixel
+struct Channels {
+    int red;
+    int green;
+    int blue;
+};
+
+Channels ChannelsOf(PixelFormat format) {
+    return format == PixelFormat::kBgra32 ? Channels{2, 1, 0} : Channels{0, 1, 2};
+}
+
+// One kernel set converts a row at a time: color to gray (in pixel order),
+// then gray into a PIX row, either as bytes or thresholded to bits
+using GrayRowFn = void (*)(const uint8_t* src, int width, PixelFormat format, uint8_t* gray);
+using StoreGrayFn = void (*)(const uint8_t* gray, int width, l_uint32* line);
+using ThresholdFn = void (*)(const uint8_t* gray, int width, int threshold, l_uint32* line);
+
+struct RowKernels {
+    const char* name;
+    GrayRowFn gray_row;
+    StoreGrayFn store_gray;
+    ThresholdFn threshold;
+};
+
+// ----------------------------------------------------------------------------
+// Scalar kernels. The vector kernels finish each row with these.
+// ----------------------------------------------------------------------------
+void GrayRowFrom(const uint8_t* src, int begin, int width, PixelFormat format, uint8_t* gray) {
+    int bpp = BytesPerPixel(format);
+    Channels c = ChannelsOf(format);
+    for (int x = begin; x < width; ++x) {
+        const uint8_t* pixel = src + static_cast<size_t>(x) * bpp;
+        gray[x] = static_cast<uint8_t>((kRedWeight * pixel[c.red] +
+                                        kGreenWeight * pixel[c.green] +
+                                        kBlueWeight * pixel[c.blue] + 128) >> 8);
+    }
+}
+
+// 8 bpp PIX rows hold each 32-bit word's leftmost pixel in its high byte,
+// which on little-endian machines is not memory order
+void StoreGrayFrom(const uint8_t* gray, int begin, int width, l_uint32* line) {
+    for (int x = begin; x < width; ++x) {
+        SET_DATA_BYTE(line, x, gray[x]);
+    }
+}
+
+// 1 bpp PIX rows: bit 31 of each word is its leftmost pixel, and 1 is ink.
+// `begin_word` starts at pixel 32 * begin_word.
+void ThresholdFrom(const uint8_t* gray, int begin_word, int width, int threshold,
+                   l_uint32* line) {
+    int words = (width + 31) / 32;
+    for (int w = begin_word; w < words; ++w) {
+        l_uint32 word = 0;
+        int end = std::min(width, (w + 1) * 32);
+        for (int x = w * 32; x < end; ++x) {
+            if (gray[x] < threshold) {
+                word |= 0x80000000u >> (x & 31);
+            }
+        }
+        line[w] = word;
+    }
+}
+
+void GrayRowScalar(const uint8_t* src, int width, PixelFormat format, uint8_t* gray) {
+    GrayRowFrom(src, 0, width, format, gray);
+}
+
+void StoreGrayScalar(const uint8_t* gray, int width, l_uint32* line) {
+    StoreGrayFrom(gray, 0, width, line);
+}
+
+void ThresholdScalar(const uint8_t* gray, int width, int threshold, l_uint32* line) {
+    ThresholdFrom(gray, 0, width, threshold, line);
+}
+
+const RowKernels kScalarKernels = {"scalar", GrayRowScalar, StoreGrayScalar, ThresholdScalar};
+
+#ifdef OCR_X86_KERNELS
+
+// movemask puts the leftmost pixel in bit 0; a PIX wants it in bit 31
+uint32_t ReverseBits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+    return __builtin_bswap32(v);
+}
+
+// RGB24 rows are read 16 bytes at a time for 12 bytes of pixels. Stopping the
+// vector loop two pixels early keeps the last load inside the row.
+constexpr int kRgbLoadSlack = 2;
+
+// ----------------------------------------------------------------------------
+// SSSE3 kernels: 16 pixels per iteration
+// ----------------------------------------------------------------------------
+__attribute__((target("ssse3")))
+void GrayRowSsse3(const uint8_t* src, int width, PixelFormat format, uint8_t* gray) {
+    Channels c = ChannelsOf(format);
+    int16_t w[4] = {0, 0, 0, 0};
+    w[c.red] = kRedWeight;
+    w[c.green] = kGreenWeight;
+    w[c.blue] = kBlueWeight;
+    const __m128i weights = _mm_setr_epi16(w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i zero = _mm_setzero_si128();
+    // R G B -> R G B 0, four pixels per register
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const bool rgb = format == PixelFormat::kRgb24;
+    const int bpp = rgb ? 3 : 4;
+    const int limit = rgb ? width - kRgbLoadSlack : width;
+
+    int x = 0;
+    for (; x + 16 <= limit; x += 16) {
+        __m128i luma[4];
+        for (int i = 0; i < 4; ++i) {
+            const uint8_t* p = src + static_cast<size_t>(x + 4 * i) * bpp;
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            if (rgb) {
+                pixels = _mm_shuffle_epi8(pixels, expand);
+            }
+            // Weighted channel pairs per pixel, then summed: four 32-bit lumas
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+            luma[i] = _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), round), 8);
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(luma[0], luma[1]),
+                                          _mm_packs_epi32(luma[2], luma[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + x), packed);
+    }
+    GrayRowFrom(src, x, width, format, gray);
+}
+
+__attribute__((target("ssse3")))
+void StoreGraySsse3(const uint8_t* gray, int width, l_uint32* line) {
+    const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    uint8_t* out = reinterpret_cast<uint8_t*>(line);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_shuffle_epi8(bytes, swap));
+    }
+    StoreGrayFrom(gray, x, width, line);
+}
+
+__attribute__((target("ssse3")))
+void ThresholdSsse3(const uint8_t* gray, int width, int threshold, l_uint32* line) {
+    // Unsigned "gray < threshold" as "min(gray, threshold - 1) == gray"
+    const __m128i below = _mm_set1_epi8(static_cast<char>(threshold - 1));
+    int w = 0;
+    for (; (w + 1) * 32 <= width; ++w) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray + w * 32));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray + w * 32 + 16));
+        uint32_t ink_a = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(a, below), a)));
+        uint32_t ink_b = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(b, below), b)));
+        line[w] = ReverseBits(ink_a | (ink_b << 16));
+    }
+    ThresholdFrom(gray, w, width, threshold, line);
+}
+
+// ----------------------------------------------------------------------------
+// AVX2 kernels: 32 pixels per iteration. Unpack, madd, hadd and pack work
+// within 128-bit lanes, so the packed gray bytes come out in groups of four
+// pixels interleaved across the lanes and one permute puts them back.
+// ----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+void GrayRowAvx2(const uint8_t* src, int width, PixelFormat format, uint8_t* gray) {
+    Channels c = ChannelsOf(format);
+    int16_t w[4] = {0, 0, 0, 0};
+    w[c.red] = kRedWeight;
+    w[c.green] = kGreenWeight;
+    w[c.blue] = kBlueWeight;
+    const __m256i weights = _mm256_setr_epi16(w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3],
+                                              w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+    const __m256i round = _mm256_set1_epi32(128);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const bool rgb = format == PixelFormat::kRgb24;
+    const int bpp = rgb ? 3 : 4;
+    const int limit = rgb ? width - kRgbLoadSlack : width;
+
+    int x = 0;
+    for (; x + 32 <= limit; x += 32) {
+        __m256i luma[4];
+        for (int i = 0; i < 4; ++i) {
+            const uint8_t* p = src + static_cast<size_t>(x + 8 * i) * bpp;
+            __m256i pixels;
+            if (rgb) {
+                // Pixels 0-3 in the low lane, 4-7 in the high lane
+                __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12));
+                pixels = _mm256_shuffle_epi8(
+                    _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1), expand);
+            } else {
+                pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            }
+            __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), weights);
+            __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), weights);
+            luma[i] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), round), 8);
+        }
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(luma[0], luma[1]),
+                                             _mm256_packs_epi32(luma[2], luma[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(gray + x),
+                            _mm256_permutevar8x32_epi32(packed, order));
+    }
+    GrayRowFrom(src, x, width, format, gray);
+}
+
+__attribute__((target("avx2")))
+void StoreGrayAvx2(const uint8_t* gray, int width, l_uint32* line) {
+    const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    uint8_t* out = reinterpret_cast<uint8_t*>(line);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gray + x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x),
+                            _mm256_shuffle_epi8(bytes, swap));
+    }
+    StoreGrayFrom(gray, x, width, line);
+}
+
+__attribute__((target("avx2")))
+void ThresholdAvx2(const uint8_t* gray, int width, int threshold, l_uint32* line) {
+    const __m256i below = _mm256_set1_epi8(static_cast<char>(threshold - 1));
+    int w = 0;
+    for (; (w + 1) * 32 <= width; ++w) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gray + w * 32));
+        uint32_t ink = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, below), bytes)));
+        line[w] = ReverseBits(ink);
+    }
+    ThresholdFrom(gray, w, width, threshold, line);
+}
+
+#endif  // OCR_X86_KERNELS
+
+const RowKernels& BestKernels() {
+    static const RowKernels best = []() {
+#ifdef OCR_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return RowKernels{"avx2", GrayRowAvx2, StoreGrayAvx2, ThresholdAvx2};
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            return RowKernels{"ssse3", GrayRowSsse3, StoreGraySsse3, ThresholdSsse3};
+        }
+#endif
+        return kScalarKernels;
+    }();
+    return best;
+}
+
+const RowKernels& KernelsFor(PixelKernels kernels) {
+    return kernels == PixelKernels::kScalar ? kScalarKernels : BestKernels();
+}
+
+}  // namespace
+
+int BytesPerPixel(PixelFormat format) {
+    switch (format) {
+    case PixelFormat::kGray8:
+        return 1;
+    case PixelFormat::kRgb24:
+        return 3;
+    case PixelFormat::kRgba32:
+    case PixelFormat::kBgra32:
+        return 4;
+    case PixelFormat::kNone:
+        break;
+    }
+    return 0;
+}
+
+bool ValidateRawImage(RawImage* image, size_t size, std::string* error) {
+    int bpp = BytesPerPixel(image->format);
+    if (bpp == 0) {
+        *error = "Unsupported raw pixel format";
+        return false;
+    }
+    if (image->width <= 0 || image->height <= 0 || image->width > kMaxRawSide ||
+        image->height > kMaxRawSide) {
+        *error = "Raw image width and height must be 1 to " + std::to_string(kMaxRawSide);
+        return false;
+    }
+    int row_bytes = image->width * bpp;
+    if (image->stride == 0) {
+        image->stride = row_bytes;
+    }
+    if (image->stride < row_bytes) {
+        *error = "Raw image stride " + std::to_string(image->stride) +
+                 " is shorter than a row of " + std::to_string(row_bytes) + " bytes";
+        return false;
+    }
+    if (image->threshold < 0 || image->threshold > 255 || image->dpi < 0) {
+        *error = "Raw image threshold must be 0 to 255 and dpi not negative";
+        return false;
+    }
+    // The last row needs no padding after it
+    size_t needed = static_cast<size_t>(image->stride) * (image->height - 1) + row_bytes;
+    if (size < needed) {
+        *error = "Raw image needs " + std::to_string(needed) + " bytes, got " +
+                 std::to_string(size);
+        return false;
+    }
+    return true;
+}
+
+PixPtr ConvertRawImage(const uint8_t* data, const RawImage& image, PixelKernels kernels) {
+    const RowKernels& k = KernelsFor(kernels);
+    const bool binary = image.threshold > 0;
+    PixPtr pix(pixCreate(image.width, image.height, binary ? 1 : 8));
+    if (!pix) {
+        return nullptr;
+    }
+    if (image.dpi > 0) {
+        pixSetResolution(pix.get(), image.dpi, image.dpi);
+    }
+
+    l_uint32* lines = pixGetData(pix.get());
+    const int wpl = pixGetWpl(pix.get());
+    const bool gray_input = image.format == PixelFormat::kGray8;
+    // One row of gray, reused; it stays in L1 between the two passes
+    std::vector<uint8_t> row_gray(gray_input ? 0 : image.width);
+
+    for (int y = 0; y < image.height; ++y) {
+        const uint8_t* row = data + static_cast<size_t>(y) * image.stride;
+        const uint8_t* gray = row;
+        if (!gray_input) {
+            k.gray_row(row, image.width, image.format, row_gray.data());
+            gray = row_gray.data();
+        }
+        l_uint32* line = lines + static_cast<size_t>(y) * wpl;
+        if (binary) {
+            k.threshold(gray, image.width, image.threshold, line);
+        } else {
+            k.store_gray(gray, image.width, line);
+        }
+    }
+    return pix;
+}
+
+const char* PixelKernelsName(PixelKernels kernels) {
+    return KernelsFor(kernels).name;
+}
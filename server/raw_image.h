@@ -0,0 +1,53 @@
+#ifndef RAW_IMAGE_H
+#define RAW_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "image_preprocess.h"
+
+// Pixel layouts of pre-decoded input. Values match ocrservice::PixelFormat.
+enum class PixelFormat {
+    kNone = 0,    // Not raw: the bytes are an encoded file
+    kGray8 = 1,   // One byte per pixel
+    kRgb24 = 2,   // R, G, B
+    kRgba32 = 3,  // R, G, B, A (alpha ignored)
+    kBgra32 = 4,  // B, G, R, A, as most capture APIs deliver
+};
+
+// Geometry of a buffer of pre-decoded pixels, top row first
+struct RawImage {
+    PixelFormat format = PixelFormat::kNone;
+    int width = 0;
+    int height = 0;
+    int stride = 0;     // Bytes from one row to the next; 0 = tightly packed
+    int dpi = 0;        // 0 = unknown
+    int threshold = 0;  // 1-255: binarize, darker pixels are ink; 0 = keep gray
+};
+
+int BytesPerPixel(PixelFormat format);
+
+// False, with a message, when the geometry is malformed or the rows do not
+// fit in `size` bytes. Fills in a zero stride.
+bool ValidateRawImage(RawImage* image, size_t size, std::string* error);
+
+// Which row kernels ConvertRawImage uses. kBest picks the widest the CPU
+// supports at run time (AVX2, then SSSE3); the scalar ones are the fallback
+// everywhere else and the reference for benchmarks.
+enum class PixelKernels { kBest, kScalar };
+
+// ============================================================================
+// ZERO-COPY: Pre-Decoded Pixel Input
+// ============================================================================
+// Builds the PIX Tesseract reads straight from a validated pixel buffer, with
+// no codec in between: 8 bpp gray, or 1 bpp when `image.threshold` is set.
+// Color is reduced with Leptonica's luminance weights (0.3, 0.5, 0.2), so
+// the result matches what pixConvertTo8 makes of the same image decoded
+// from a file. Returns null only if the PIX cannot be allocated.
+PixPtr ConvertRawImage(const uint8_t* data, const RawImage& image,
+                       PixelKernels kernels = PixelKernels::kBest);
+
+// "avx2", "ssse3" or "scalar"
+const char* PixelKernelsName(PixelKernels kernels);
+
+#endif // RAW_IMAGE_H
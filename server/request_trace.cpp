@@ -0,0 +1,165 @@
+#include "request_trace.h"
+#include <unistd.h>
+#include <algorithm>
+#include <set>
+#include <utility>
+
+namespace {
+
+// Timeline row ids. Each traced request gets a block of rows: its own, then
+// one per document part. Blocks are reused after kRequestRows requests.
+constexpr int kDecodeRowBase = 1000;
+constexpr int kRecognitionRowBase = 2000;
+constexpr int kRequestRowBase = 10000;
+constexpr int kRowsPerRequest = 64;
+constexpr int kRequestRows = 30000;
+
+int RowOf(int request_row, RequestTrace::Lane lane, int worker, int part) {
+    switch (lane) {
+    case RequestTrace::kDecodeLane:
+        return kDecodeRowBase + worker;
+    case RequestTrace::kRecognitionLane:
+        return kRecognitionRowBase + worker;
+    case RequestTrace::kRequestLane:
+        break;
+    }
+    int base = kRequestRowBase + request_row * kRowsPerRequest;
+    return part < 0 ? base : base + 1 + std::min(part, kRowsPerRequest - 2);
+}
+
+}  // namespace
+
+RequestTrace::RequestTrace(const TraceContext& context, std::string image_id,
+                           size_t image_bytes, TimePoint received)
+    : context_(context), image_id_(std::move(image_id)), image_bytes_(image_bytes),
+      received_(received) {}
+
+void RequestTrace::AddSpan(const char* name, TimePoint start, TimePoint end, Lane lane,
+                           int worker, int part) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans_.push_back(Span{name, start, end, lane, worker, part});
+}
+
+TraceRecorder::TraceRecorder(uint32_t sample_every, size_t capacity)
+    : sample_every_(sample_every), capacity_(capacity), pid_(static_cast<int>(getpid())),
+      steady_base_(std::chrono::steady_clock::now()), wall_base_us_(WallClockMicros()) {}
+
+std::shared_ptr<RequestTrace> TraceRecorder::Begin(const TraceContext& client,
+                                                   const std::string& image_id,
+                                                   size_t image_bytes,
+                                                   RequestTrace::TimePoint received) {
+    if (capacity_ == 0) {
+        return nullptr;
+    }
+    TraceContext context = client;
+    if (!(client.valid() && client.sampled)) {
+        if (sample_every_ == 0 ||
+            requests_.fetch_add(1, std::memory_order_relaxed) % sample_every_ != 0) {
+            return nullptr;
+        }
+        // Sampled here: keep the client's trace id if it sent one
+        context = client.valid() ? client : TraceContext::NewTrace(true);
+    }
+    return std::make_shared<RequestTrace>(context, image_id, image_bytes, received);
+}
+
+void TraceRecorder::Finish(const std::shared_ptr<RequestTrace>& trace, const char* outcome) {
+    if (!trace) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(trace->mutex_);
+        trace->outcome_ = outcome;
+        trace->spans_.push_back(RequestTrace::Span{"request", trace->received_,
+                                                   std::chrono::steady_clock::now(),
+                                                   RequestTrace::kRequestLane, -1, -1});
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    trace->row_ = next_row_;
+    next_row_ = (next_row_ + 1) % kRequestRows;
+    finished_.push_back(trace);
+    if (finished_.size() > capacity_) {
+        finished_.pop_front();
+    }
+}
+
+int64_t TraceRecorder::WallMicros(RequestTrace::TimePoint time) const {
+    return wall_base_us_ +
+           std::chrono::duration_cast<std::chrono::microseconds>(time - steady_base_).count();
+}
+
+int TraceRecorder::Export(const std::string& trace_id, bool clear, std::string* events) {
+    std::vector<std::shared_ptr<RequestTrace>> selected;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = finished_.begin(); it != finished_.end();) {
+            if (!trace_id.empty() && (*it)->context().TraceIdHex() != trace_id) {
+                ++it;
+                continue;
+            }
+            selected.push_back(*it);
+            it = clear ? finished_.erase(it) : std::next(it);
+        }
+    }
+
+    AppendProcessName(pid_, "ocr_server", events);
+    std::set<std::pair<RequestTrace::Lane, int>> workers;
+    for (const auto& trace : selected) {
+        std::lock_guard<std::mutex> lock(trace->mutex_);
+        for (const RequestTrace::Span& span : trace->spans_) {
+            if (span.lane != RequestTrace::kRequestLane) {
+                workers.emplace(span.lane, span.worker);
+            }
+        }
+        AppendTrace(*trace, events);
+    }
+    for (const auto& worker : workers) {
+        bool decode = worker.first == RequestTrace::kDecodeLane;
+        AppendThreadName(pid_, RowOf(0, worker.first, worker.second, -1),
+                         (decode ? "decode worker " : "recognition worker ") +
+                             std::to_string(worker.second),
+                         events);
+    }
+    return static_cast<int>(selected.size());
+}
+
+// Requires trace.mutex_
+void TraceRecorder::AppendTrace(const RequestTrace& trace, std::string* events) const {
+    const std::string trace_id = trace.context().TraceIdHex();
+    std::set<int> parts;
+    for (const RequestTrace::Span& span : trace.spans_) {
+        TraceEvent event;
+        event.name = span.name;
+        event.start_us = WallMicros(span.start);
+        event.duration_us = std::max<int64_t>(
+            0, std::chrono::duration_cast<std::chrono::microseconds>(span.end - span.start)
+                   .count());
+        event.pid = pid_;
+        event.tid = RowOf(trace.row_, span.lane, span.worker, span.part);
+        event.AddArg("image", trace.image_id_);
+        event.AddArg("trace_id", trace_id);
+        if (span.worker >= 0) {
+            event.AddArg("worker", span.worker);
+        }
+        if (span.part >= 0) {
+            event.AddArg("part", span.part);
+            if (span.lane == RequestTrace::kRequestLane) {
+                parts.insert(span.part);
+            }
+        }
+        if (span.lane == RequestTrace::kRequestLane && span.part < 0 &&
+            std::string(span.name) == "request") {
+            event.AddArg("bytes", static_cast<int64_t>(trace.image_bytes_));
+            event.AddArg("parent_span", trace.context().SpanIdHex());
+            event.AddArg("outcome", trace.outcome_);
+        }
+        AppendTraceEvent(event, events);
+    }
+
+    AppendThreadName(pid_, RowOf(trace.row_, RequestTrace::kRequestLane, -1, -1),
+                     trace.image_id_, events);
+    for (int part : parts) {
+        AppendThreadName(pid_, RowOf(trace.row_, RequestTrace::kRequestLane, -1, part),
+                         trace.image_id_ + " part " + std::to_string(part + 1), events);
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef REQUEST_TRACE_H
+#define REQUEST_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "trace_context.h"
+
+// ============================================================================
+// MONITORING: Per-Request Tracing
+// ============================================================================
+// The spans of one traced request: receive, queue wait, decode, ready wait,
+// recognize, every write, and the request as a whole. Each stage adds its
+// span from whichever thread ran it. Untraced requests carry no RequestTrace,
+// so all they pay is a null check per stage.
+class RequestTrace {
+public:
+    // Timeline rows: the request's own row (one more per document part), and
+    // one row per decode or recognition worker
+    enum Lane { kRequestLane, kDecodeLane, kRecognitionLane };
+
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    RequestTrace(const TraceContext& context, std::string image_id, size_t image_bytes,
+                 TimePoint received);
+
+    // `part` is the page or block of a document part, otherwise -1
+    void AddSpan(const char* name, TimePoint start, TimePoint end, Lane lane = kRequestLane,
+                 int worker = -1, int part = -1);
+
+    const TraceContext& context() const { return context_; }
+
+private:
+    friend class TraceRecorder;
+
+    struct Span {
+        const char* name;
+        TimePoint start;
+        TimePoint end;
+        Lane lane;
+        int worker;
+        int part;
+    };
+
+    const TraceContext context_;  // The client's, or a new trace for server-sampled requests
+    const std::string image_id_;
+    const size_t image_bytes_;
+    const TimePoint received_;
+
+    std::mutex mutex_;
+    std::vector<Span> spans_;
+    int row_ = 0;             // Assigned when finished
+    const char* outcome_ = "";
+};
+
+// Decides which requests are traced and keeps the most recently finished
+// ones for export. Requests the client marked as sampled (in its
+// "traceparent") are always traced; others one in `sample_every`.
+class TraceRecorder {
+public:
+    // `sample_every` 0 traces only client-sampled requests; `capacity` 0
+    // turns tracing off
+    TraceRecorder(uint32_t sample_every, size_t capacity);
+
+    // Null when this request is not traced. `client` may be invalid.
+    std::shared_ptr<RequestTrace> Begin(const TraceContext& client, const std::string& image_id,
+                                        size_t image_bytes, RequestTrace::TimePoint received);
+
+    // Closes the request span and keeps the trace, dropping the oldest past
+    // capacity. Accepts null.
+    void Finish(const std::shared_ptr<RequestTrace>& trace, const char* outcome);
+
+    // Appends the kept traces (only `trace_id`'s, if not empty) as Chrome
+    // trace events, see AppendTraceEvent; `clear` forgets the exported
+    // ones. Returns the number of requests exported.
+    int Export(const std::string& trace_id, bool clear, std::string* events);
+
+private:
+    int64_t WallMicros(RequestTrace::TimePoint time) const;
+    void AppendTrace(const RequestTrace& trace, std::string* events) const;
+
+    const uint32_t sample_every_;
+    const size_t capacity_;
+    const int pid_;
+    std::atomic<uint64_t> requests_{0};
+
+    // Steady-clock spans are placed on the wall clock through this pair
+    const RequestTrace::TimePoint steady_base_;
+    const int64_t wall_base_us_;
+
+    std::mutex mutex_;
+    std::deque<std::shared_ptr<RequestTrace>> finished_;
+    int next_row_ = 0;
+};
+
+#endif // REQUEST_TRACE_H
@@ -0,0 +1,163 @@
+#include "result_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+// Persistence file layout: magic, version, then (key, length, text) records.
+// Version 2: keys combine the plain content hash with the settings hash.
+constexpr char kCacheMagic[4] = {'O', 'C', 'R', 'C'};
+constexpr uint32_t kCacheVersion = 2;
+
+}  // namespace
+
+ResultCache::ResultCache(size_t max_bytes, int num_shards)
+    : hits_(0), misses_(0) {
+    if (num_shards < 1) {
+        num_shards = 1;
+    }
+    for (int i = 0; i < num_shards; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+    shard_capacity_ = max_bytes / num_shards;
+}
+
+ResultCache::Shard& ResultCache::ShardFor(uint64_t key) const {
+    // Low bits feed the per-shard hash table, so pick the shard from the top
+    return *shards_[(key >> 48) % shards_.size()];
+}
+
+size_t ResultCache::EntryCost(const std::string& text) {
+    // Text plus a rough allowance for the list node and index slot
+    return text.size() + 64;
+}
+
+bool ResultCache::Lookup(uint64_t key, std::string* text) {
+    Shard& shard = ShardFor(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            *text = it->second->second;
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void ResultCache::Insert(uint64_t key, const std::string& text) {
+    size_t cost = EntryCost(text);
+    if (cost > shard_capacity_) {
+        return;  // Would evict the whole shard for a single entry
+    }
+
+    Shard& shard = ShardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.bytes -= EntryCost(it->second->second);
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    shard.lru.emplace_front(key, text);
+    shard.index[key] = shard.lru.begin();
+    shard.bytes += cost;
+
+    // Evict least recently used entries until the shard fits its budget
+    while (shard.bytes > shard_capacity_ && !shard.lru.empty()) {
+        auto& victim = shard.lru.back();
+        shard.bytes -= EntryCost(victim.second);
+        shard.index.erase(victim.first);
+        shard.lru.pop_back();
+    }
+}
+
+size_t ResultCache::entries() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->index.size();
+    }
+    return total;
+}
+
+size_t ResultCache::bytes() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->bytes;
+    }
+    return total;
+}
+
+bool ResultCache::Load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    const std::streamoff file_size = file.tellg();
+    file.seekg(0);
+
+    char magic[4];
+    uint32_t version = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!file || std::memcmp(magic, kCacheMagic, sizeof(magic)) != 0 ||
+        version != kCacheVersion) {
+        return false;
+    }
+
+    // Records are stored oldest first, so inserting in order restores recency
+    uint64_t key;
+    uint32_t length;
+    std::string text;
+    while (file.read(reinterpret_cast<char*>(&key), sizeof(key)) &&
+           file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        // A corrupt length must not size the buffer: nothing past the end of
+        // the file can be a record, so stop at the first one that claims to be
+        if (length > file_size - file.tellg()) {
+            return false;
+        }
+        text.resize(length);
+        if (!file.read(&text[0], length)) {
+            return false;  // Truncated file; keep what was loaded
+        }
+        Insert(key, text);
+    }
+    return true;
+}
+
+bool ResultCache::Save(const std::string& path) const {
+    // Write to a temporary file first so a crash never leaves a torn cache
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+
+        file.write(kCacheMagic, sizeof(kCacheMagic));
+        file.write(reinterpret_cast<const char*>(&kCacheVersion), sizeof(kCacheVersion));
+
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            for (auto it = shard->lru.rbegin(); it != shard->lru.rend(); ++it) {
+                uint32_t length = static_cast<uint32_t>(it->second.size());
+                file.write(reinterpret_cast<const char*>(&it->first), sizeof(it->first));
+                file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                file.write(it->second.data(), length);
+            }
+        }
+
+        if (!file) {
+            return false;
+        }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,56 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "content_hash.h"
+
+// ============================================================================
+// CACHING: Content-Addressed OCR Result Cache
+// ============================================================================
+// Maps a content key (hash of the image bytes + engine settings) to the text
+// Tesseract produced for it. Entries are split over independently locked
+// shards, each an LRU list bounded by its share of the byte budget, so
+// concurrent handlers rarely contend on the same mutex.
+class ResultCache {
+public:
+    ResultCache(size_t max_bytes, int num_shards = 16);
+
+    bool Lookup(uint64_t key, std::string* text);
+    void Insert(uint64_t key, const std::string& text);
+
+    // Optional persistence so a restarted server starts warm
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    size_t entries() const;
+    size_t bytes() const;
+
+private:
+    struct Shard {
+        using Entry = std::pair<uint64_t, std::string>;
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // Most recently used at the front
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    Shard& ShardFor(uint64_t key) const;
+    static size_t EntryCost(const std::string& text);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_capacity_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,417 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// MULTITHREADING: Chase-Lev Work-Stealing Deque
+// ============================================================================
+// Lock-free deque owned by one worker. The owner pushes and pops at the
+// bottom (LIFO, cache-warm); other workers steal from the top (FIFO).
+// Follows Le, Pop, Cohen & Zappa Nardelli, "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (PPoPP 2013).
+template <typename T>
+class ChaseLevDeque {
+public:
+    explicit ChaseLevDeque(int64_t capacity = 64)
+        : top_(0), bottom_(0) {
+        retired_.push_back(std::make_unique<Ring>(capacity));
+        ring_.store(retired_.back().get(), std::memory_order_relaxed);
+    }
+
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+    // Owner only
+    void Push(T* item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        if (b - t > ring->capacity - 1) {
+            ring = Grow(ring, t, b);
+        }
+        ring->Put(b, item);
+        // Publishes the slot (and the item) to thieves that read bottom_; a
+        // release store rather than the paper's fence, which ThreadSanitizer
+        // cannot follow
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only
+    T* Pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);  // Was empty
+            return nullptr;
+        }
+
+        T* item = ring->Get(b);
+        if (t == b) {
+            // Last element: race any thief for it
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread
+    T* Steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+
+        Ring* ring = ring_.load(std::memory_order_acquire);
+        T* item = ring->Get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return nullptr;  // Lost the race to the owner or another thief
+        }
+        return item;
+    }
+
+    bool Empty() const {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Ring {
+        explicit Ring(int64_t cap)
+            : capacity(cap), mask(cap - 1), slots(new std::atomic<T*>[cap]) {}
+
+        T* Get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void Put(int64_t i, T* item) { slots[i & mask].store(item, std::memory_order_relaxed); }
+
+        int64_t capacity;  // Always a power of two
+        int64_t mask;
+        std::unique_ptr<std::atomic<T*>[]> slots;
+    };
+
+    Ring* Grow(Ring* old_ring, int64_t t, int64_t b) {
+        // Thieves may still be reading the old ring, so it is retired rather
+        // than freed; all rings are released with the deque
+        auto ring = std::make_unique<Ring>(old_ring->capacity * 2);
+        for (int64_t i = t; i < b; ++i) {
+            ring->Put(i, old_ring->Get(i));
+        }
+        Ring* raw = ring.get();
+        retired_.push_back(std::move(ring));
+        ring_.store(raw, std::memory_order_release);
+        return raw;
+    }
+
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    std::atomic<Ring*> ring_;
+    std::vector<std::unique_ptr<Ring>> retired_;  // Owner only
+};
+
+// ============================================================================
+// MULTITHREADING: Bounded Lock-Free MPMC Ring
+// ============================================================================
+// Dmitry Vyukov's bounded multi-producer/multi-consumer queue. Serves as
+// each worker's inbox for tasks submitted from outside the pool (gRPC
+// handlers), which cannot push onto a Chase-Lev deque they don't own.
+template <typename T>
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacity)
+        : mask_(RoundUpPow2(capacity) - 1), cells_(new Cell[mask_ + 1]),
+          enqueue_pos_(0), dequeue_pos_(0) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    bool TryPush(T* item) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.item = item;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    T* TryPop() {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    T* item = cell.item;
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return item;
+                }
+            } else if (diff < 0) {
+                return nullptr;  // Empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T* item;
+    };
+
+    static size_t RoundUpPow2(size_t n) {
+        size_t p = 2;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+// ============================================================================
+// MULTITHREADING: Work-Stealing Scheduler
+// ============================================================================
+// Replaces the single mutex-protected task queue. Every worker owns a
+// Chase-Lev deque (tasks it spawns itself) and a lock-free inbox (tasks
+// submitted from other threads, spread round-robin). A worker looks at its
+// own deque, then its inbox, then steals from the others, so no lock is
+// taken on the hot path. Idle workers park on an event count and are woken
+// only when there are sleepers to wake.
+//
+// The pool can shrink and grow at run time: only the first active_workers()
+// workers take work. The rest stand by on their own condition variable, so
+// a WakeOne never lands on a worker that would go straight back to sleep.
+// Tasks left in a stood-down worker's queues are stolen by the active ones.
+template <typename T>
+class WorkStealingScheduler {
+public:
+    explicit WorkStealingScheduler(int num_workers, size_t inbox_capacity = 1024)
+        : next_inbox_(0), active_(num_workers), sleepers_(0), epoch_(0), stopped_(false) {
+        for (int i = 0; i < num_workers; ++i) {
+            workers_.push_back(std::make_unique<Worker>(inbox_capacity));
+        }
+    }
+
+    ~WorkStealingScheduler() {
+        // Free any tasks nobody picked up
+        for (auto& worker : workers_) {
+            while (T* item = worker->deque.Steal()) {
+                delete item;
+            }
+            while (T* item = worker->inbox.TryPop()) {
+                delete item;
+            }
+        }
+        for (T* item : overflow_) {
+            delete item;
+        }
+    }
+
+    int num_workers() const { return static_cast<int>(workers_.size()); }
+    int active_workers() const { return active_.load(std::memory_order_acquire); }
+
+    // Any thread. Clamped to [1, num_workers()].
+    void SetActiveWorkers(int count) {
+        count = std::max(1, std::min(count, num_workers()));
+        {
+            std::lock_guard<std::mutex> lock(park_mutex_);
+            active_.store(count, std::memory_order_release);
+            epoch_.fetch_add(1, std::memory_order_release);
+        }
+        // Parked workers re-check whether they are still active; standby
+        // workers whether they may start taking work
+        park_cv_.notify_all();
+        standby_cv_.notify_all();
+    }
+
+    // Any thread
+    void Submit(std::unique_ptr<T> task) {
+        T* item = task.release();
+        size_t start = next_inbox_.fetch_add(1, std::memory_order_relaxed);
+        size_t active = static_cast<size_t>(active_workers());
+        bool pushed = false;
+        for (size_t i = 0; i < active && !pushed; ++i) {
+            pushed = workers_[(start + i) % active]->inbox.TryPush(item);
+        }
+        if (!pushed) {
+            // Every inbox is full: rare, so a plain mutex is fine here
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            overflow_.push_back(item);
+            overflow_size_.fetch_add(1, std::memory_order_relaxed);
+        }
+        WakeOne();
+    }
+
+    // Worker `worker` only: queue a subtask on the worker's own deque
+    void SubmitLocal(int worker, std::unique_ptr<T> task) {
+        workers_[worker]->deque.Push(task.release());
+        WakeOne();
+    }
+
+    // Worker loop: blocks until there is a task for `worker` or the scheduler
+    // is stopped and drained, in which case it returns nullptr
+    std::unique_ptr<T> Next(int worker) {
+        for (;;) {
+            if (worker >= active_workers()) {
+                std::unique_lock<std::mutex> lock(park_mutex_);
+                standby_cv_.wait(lock, [this, worker]() {
+                    return worker < active_workers() || stopped_.load(std::memory_order_acquire);
+                });
+                if (worker >= active_workers()) {
+                    return nullptr;  // Stopped; the active workers drain what is left
+                }
+                continue;
+            }
+
+            if (T* item = FindTask(worker)) {
+                return std::unique_ptr<T>(item);
+            }
+
+            // Prepare to park, then look once more so a task submitted
+            // concurrently is never missed (event-count protocol)
+            uint64_t epoch = epoch_.load(std::memory_order_acquire);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (T* item = FindTask(worker)) {
+                sleepers_.fetch_sub(1, std::memory_order_relaxed);
+                return std::unique_ptr<T>(item);
+            }
+            if (stopped_.load(std::memory_order_acquire)) {
+                sleepers_.fetch_sub(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(park_mutex_);
+                park_cv_.wait(lock, [this, epoch]() {
+                    return epoch_.load(std::memory_order_acquire) != epoch ||
+                           stopped_.load(std::memory_order_acquire);
+                });  // SetActiveWorkers also bumps the epoch
+            }
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void Stop() {
+        stopped_.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(park_mutex_);
+            epoch_.fetch_add(1, std::memory_order_release);
+        }
+        park_cv_.notify_all();
+        standby_cv_.notify_all();
+    }
+
+private:
+    struct Worker {
+        explicit Worker(size_t inbox_capacity) : inbox(inbox_capacity), rng(0) {}
+
+        ChaseLevDeque<T> deque;
+        MpmcRing<T> inbox;
+        uint32_t rng;  // Victim selection; touched only by the owner
+    };
+
+    T* FindTask(int index) {
+        Worker& self = *workers_[index];
+        if (T* item = self.deque.Pop()) {
+            return item;
+        }
+        if (T* item = self.inbox.TryPop()) {
+            return item;
+        }
+        if (overflow_size_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            if (!overflow_.empty()) {
+                T* item = overflow_.front();
+                overflow_.pop_front();
+                overflow_size_.fetch_sub(1, std::memory_order_relaxed);
+                return item;
+            }
+        }
+
+        // Steal, starting at a pseudo-random victim so thieves spread out
+        size_t n = workers_.size();
+        self.rng = self.rng * 1664525u + 1013904223u + static_cast<uint32_t>(index);
+        size_t start = self.rng % n;
+        for (size_t i = 0; i < n; ++i) {
+            size_t victim = (start + i) % n;
+            if (victim == static_cast<size_t>(index)) {
+                continue;
+            }
+            if (T* item = workers_[victim]->deque.Steal()) {
+                return item;
+            }
+            if (T* item = workers_[victim]->inbox.TryPop()) {
+                return item;
+            }
+        }
+        return nullptr;
+    }
+
+    void WakeOne() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_seq_cst) == 0) {
+            return;  // Nobody parked: no lock, no syscall
+        }
+        {
+            std::lock_guard<std::mutex> lock(park_mutex_);
+            epoch_.fetch_add(1, std::memory_order_release);
+        }
+        park_cv_.notify_one();
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_inbox_;
+    std::atomic<int> active_;
+
+    std::mutex overflow_mutex_;
+    std::deque<T*> overflow_;
+    std::atomic<size_t> overflow_size_{0};
+
+    std::mutex park_mutex_;
+    std::condition_variable park_cv_;
+    std::condition_variable standby_cv_;
+    std::atomic<int> sleepers_;
+    std::atomic<uint64_t> epoch_;
+    std::atomic<bool> stopped_;
+};
+
+#endif // TASK_SCHEDULER_H
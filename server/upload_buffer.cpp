@@ -0,0 +1,112 @@
+#include "upload_buffer.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+UploadBuffer::UploadBuffer(size_t memory_limit, const std::string& spool_dir)
+    : memory_limit_(memory_limit), spool_dir_(spool_dir) {
+    if (spool_dir_.empty()) {
+        const char* tmpdir = std::getenv("TMPDIR");
+        spool_dir_ = (tmpdir != nullptr && *tmpdir != '\0') ? tmpdir : "/tmp";
+    }
+}
+
+UploadBuffer::~UploadBuffer() {
+    if (mapping_ != nullptr) {
+        ::munmap(mapping_, size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool UploadBuffer::Reserve(uint64_t expected_size) {
+    if (expected_size > memory_limit_) {
+        return Spool();  // Known to be large: skip the heap entirely
+    }
+    expected_size_ = static_cast<size_t>(expected_size);
+    return true;
+}
+
+bool UploadBuffer::Append(const std::string& chunk) {
+    if (!spooled() && memory_.size() + chunk.size() > memory_limit_ && !Spool()) {
+        return false;
+    }
+    size_ += chunk.size();
+    if (spooled()) {
+        return WriteAll(chunk.data(), chunk.size());
+    }
+    size_t needed = memory_.size() + chunk.size();
+    if (needed > memory_.capacity()) {
+        // Double with what has arrived, but never past the declared total, so
+        // a header alone pins no memory and the last growth lands exactly
+        size_t cap = needed <= expected_size_ ? expected_size_ : memory_limit_;
+        memory_.reserve(std::max(needed, std::min(2 * memory_.capacity(), cap)));
+    }
+    memory_.append(chunk);
+    return true;
+}
+
+bool UploadBuffer::Finish() {
+    if (!spooled()) {
+        data_ = reinterpret_cast<const uint8_t*>(memory_.data());
+        return true;
+    }
+    if (size_ == 0) {
+        return true;
+    }
+    // The file's pages are still in the page cache, so mapping them back
+    // costs no disk reads for an image that is decoded right away
+    mapping_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        error_ = std::string("Cannot map upload spool file: ") + std::strerror(errno);
+        return false;
+    }
+    ::madvise(mapping_, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const uint8_t*>(mapping_);
+    return true;
+}
+
+// Moves the upload to an anonymous temp file; whatever was buffered in
+// memory so far is written out first
+bool UploadBuffer::Spool() {
+    if (spooled()) {
+        return true;
+    }
+    std::string path = spool_dir_ + "/ocr_upload_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    fd_ = ::mkstemp(name.data());
+    if (fd_ < 0) {
+        error_ = "Cannot create upload spool file in " + spool_dir_ + ": " + std::strerror(errno);
+        return false;
+    }
+    // Unlinked right away: the space is reclaimed however the call ends
+    ::unlink(name.data());
+
+    std::string buffered;
+    buffered.swap(memory_);
+    return WriteAll(buffered.data(), buffered.size());
+}
+
+bool UploadBuffer::WriteAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_ = std::string("Cannot write upload spool file: ") + std::strerror(errno);
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef UPLOAD_BUFFER_H
+#define UPLOAD_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ============================================================================
+// ZERO-COPY: Chunked Upload Assembly
+// ============================================================================
+// Collects the chunks of one UploadImage call into a single contiguous image.
+// Uploads up to `memory_limit` bytes go into one heap buffer that grows with
+// the bytes received, doubling up to the size the client declared.
+// Larger uploads are spooled to an unlinked temp file and memory-mapped once
+// complete, so the decoder reads them from the page cache instead of the heap.
+class UploadBuffer {
+public:
+    // `spool_dir` empty means $TMPDIR, else /tmp
+    UploadBuffer(size_t memory_limit, const std::string& spool_dir);
+    ~UploadBuffer();
+    UploadBuffer(const UploadBuffer&) = delete;
+    UploadBuffer& operator=(const UploadBuffer&) = delete;
+
+    // `expected_size` is the client's declared total; 0 when unknown
+    bool Reserve(uint64_t expected_size);
+    bool Append(const std::string& chunk);
+    // Ends the upload; data() is valid from here on
+    bool Finish();
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool spooled() const { return fd_ >= 0; }
+    const std::string& error() const { return error_; }
+
+private:
+    bool Spool();
+    bool WriteAll(const char* data, size_t size);
+
+    size_t memory_limit_;
+    std::string spool_dir_;
+    std::string memory_;
+    size_t expected_size_ = 0;
+    int fd_ = -1;
+    void* mapping_ = nullptr;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::string error_;
+};
+
+#endif // UPLOAD_BUFFER_H
@@ -32,7 +32,17 @@ install_dependencies() {
         debian)
             echo "Installing dependencies for Debian/Ubuntu..."
             sudo apt update
-            sudo apt install -y cmake build-essential qt5-default \
+            # Ubuntu releases before 24.04 ship Tesseract 4; the server needs 5
+            if ! apt-cache show libtesseract-dev 2>/dev/null | grep -q '^Version: 5'; then
+                if command -v add-apt-repository &> /dev/null; then
+                    echo "Adding the Tesseract 5 PPA..."
+                    sudo add-apt-repository -y ppa:alex-p/tesseract-ocr5
+                    sudo apt update
+                else
+                    echo "Warning: this release ships Tesseract 4, but Tesseract 5 is required."
+                fi
+            fi
+            sudo apt install -y cmake build-essential qtbase5-dev \
                 libgrpc++-dev libprotobuf-dev protobuf-compiler-grpc \
                 libtesseract-dev libleptonica-dev tesseract-ocr-eng \
                 pkg-config
@@ -0,0 +1,179 @@
+// ============================================================================
+// CACHING: Result Cache Persistence Tests
+// ============================================================================
+// ResultCache::Save followed by Load must give back every entry, byte for
+// byte and in the same recency order, whatever the shard counts. Load must
+// reject files that are not caches and stop cleanly at a truncated or
+// corrupt record, keeping the records before it.
+#include "result_cache.h"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                   \
+    do {                                                                   \
+        if (!(condition)) {                                                \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,    \
+                         __LINE__, #condition);                            \
+            ++failures;                                                    \
+        }                                                                  \
+    } while (0)
+
+// Per-process, so parallel ctest runs do not share files
+std::string TempPath(const std::string& name) {
+    return (std::filesystem::temp_directory_path() /
+            ("result_cache_test_" + std::to_string(::getpid()) + "_" + name)).string();
+}
+
+std::string TextFor(uint64_t key) {
+    std::string text = "text " + std::to_string(key);
+    if (key % 7 == 0) {
+        text.push_back('\0');  // Records are length-prefixed, not NUL-terminated
+        text += "after nul";
+    }
+    if (key % 11 == 0) {
+        text.clear();
+    }
+    return text;
+}
+
+void WriteRecord(std::ofstream& file, uint64_t key, uint32_t length, const std::string& text) {
+    file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    file.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+void WriteHeader(std::ofstream& file, uint32_t version = 2) {
+    file.write("OCRC", 4);
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+}
+
+void TestRoundTrip() {
+    constexpr uint64_t kEntries = 2000;
+    std::string path = TempPath("round_trip");
+
+    ResultCache saved(64 << 20, 16);
+    for (uint64_t key = 1; key <= kEntries; ++key) {
+        saved.Insert(key * 0x9E3779B97F4A7C15ull, TextFor(key));
+    }
+    CHECK(saved.Save(path));
+    CHECK(!std::filesystem::exists(path + ".tmp"));
+
+    ResultCache loaded(64 << 20, 4);  // Shard count is not part of the format
+    CHECK(loaded.Load(path));
+    CHECK(loaded.entries() == kEntries);
+    CHECK(loaded.bytes() == saved.bytes());
+    for (uint64_t key = 1; key <= kEntries; ++key) {
+        std::string text;
+        CHECK(loaded.Lookup(key * 0x9E3779B97F4A7C15ull, &text));
+        CHECK(text == TextFor(key));
+    }
+
+    // Saving again replaces the file rather than appending to it
+    CHECK(loaded.Save(path));
+    ResultCache reloaded(64 << 20);
+    CHECK(reloaded.Load(path));
+    CHECK(reloaded.entries() == kEntries);
+
+    std::filesystem::remove(path);
+}
+
+void TestRecencySurvivesReload() {
+    // One shard with room for exactly three 10-byte entries (64 bytes of
+    // overhead each), so the next insert evicts the least recently used
+    constexpr size_t kCapacity = 3 * (10 + 64);
+    std::string path = TempPath("recency");
+
+    ResultCache saved(kCapacity, 1);
+    saved.Insert(1, "0123456789");
+    saved.Insert(2, "0123456789");
+    saved.Insert(3, "0123456789");
+    std::string text;
+    CHECK(saved.Lookup(1, &text));  // 2 is now the oldest
+    CHECK(saved.Save(path));
+
+    ResultCache loaded(kCapacity, 1);
+    CHECK(loaded.Load(path));
+    loaded.Insert(4, "0123456789");
+    CHECK(loaded.Lookup(1, &text));
+    CHECK(!loaded.Lookup(2, &text));
+    CHECK(loaded.Lookup(3, &text));
+    CHECK(loaded.Lookup(4, &text));
+
+    std::filesystem::remove(path);
+}
+
+void TestRejectsOtherFiles() {
+    ResultCache cache(1 << 20);
+    CHECK(!cache.Load(TempPath("does_not_exist")));
+
+    std::string path = TempPath("bad_header");
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "not a cache file";
+    }
+    CHECK(!cache.Load(path));
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        WriteHeader(file, 1);  // An older format version
+        WriteRecord(file, 1, 5, "hello");
+    }
+    CHECK(!cache.Load(path));
+    CHECK(cache.entries() == 0);
+
+    std::filesystem::remove(path);
+}
+
+void TestStopsAtCorruptRecords() {
+    std::string path = TempPath("corrupt");
+    std::string text;
+
+    // A length far past the end of the file must not size a buffer
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        WriteHeader(file);
+        WriteRecord(file, 1, 5, "hello");
+        WriteRecord(file, 2, 0xFFFFFFFFu, "world");
+    }
+    ResultCache corrupt(1 << 20);
+    CHECK(!corrupt.Load(path));
+    CHECK(corrupt.entries() == 1);
+    CHECK(corrupt.Lookup(1, &text) && text == "hello");
+
+    // A file cut off in the middle of the last record
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        WriteHeader(file);
+        WriteRecord(file, 1, 5, "hello");
+        WriteRecord(file, 2, 5, "wor");
+    }
+    ResultCache truncated(1 << 20);
+    CHECK(!truncated.Load(path));
+    CHECK(truncated.entries() == 1);
+    CHECK(!truncated.Lookup(2, &text));
+
+    std::filesystem::remove(path);
+}
+
+}  // namespace
+
+int main() {
+    TestRoundTrip();
+    TestRecencySurvivesReload();
+    TestRejectsOtherFiles();
+    TestStopsAtCorruptRecords();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "result_cache_test: %d failure(s)\n", failures);
+        return 1;
+    }
+    std::printf("result_cache_test: OK\n");
+    return 0;
+}
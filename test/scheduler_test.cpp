@@ -0,0 +1,235 @@
+// ============================================================================
+// MULTITHREADING: Work-Stealing Scheduler Tests
+// ============================================================================
+// Exercises task_scheduler.h under real concurrency:
+//   - the Chase-Lev deque with its owner pushing and popping while thieves
+//     steal, every item taken exactly once;
+//   - the scheduler with external producers, worker-local forks, a tiny
+//     inbox (so the overflow queue is used) and a pool resized while it
+//     runs, every task run exactly once;
+//   - park/wake and Stop: one task at a time submitted to parked workers,
+//     none of which may sleep through it, and tasks queued before Stop
+//     still run.
+// A lost task or wakeup shows up as a timeout rather than a hang. Worth
+// running under -fsanitize=thread as well.
+#include "task_scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr auto kTimeout = std::chrono::seconds(30);
+
+int failures = 0;
+
+#define CHECK(condition)                                                   \
+    do {                                                                   \
+        if (!(condition)) {                                                \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,    \
+                         __LINE__, #condition);                            \
+            ++failures;                                                    \
+        }                                                                  \
+    } while (0)
+
+// Every counter must have been bumped exactly once
+bool AllOnce(const std::vector<std::atomic<int>>& counts) {
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i].load() != 1) {
+            std::fprintf(stderr, "item %zu taken %d times\n", i, counts[i].load());
+            return false;
+        }
+    }
+    return true;
+}
+
+void TestDequePushPopSteal() {
+    constexpr int kItems = 200000;
+    constexpr int kThieves = 3;
+    std::vector<int> items(kItems);
+    std::vector<std::atomic<int>> counts(kItems);
+    for (int i = 0; i < kItems; ++i) {
+        items[i] = i;
+    }
+
+    ChaseLevDeque<int> deque(4);  // Small, so it grows under the thieves
+    std::atomic<bool> owner_done(false);
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < kThieves; ++i) {
+        thieves.emplace_back([&]() {
+            for (;;) {
+                bool done = owner_done.load(std::memory_order_acquire);
+                if (int* item = deque.Steal()) {
+                    counts[*item].fetch_add(1);
+                } else if (done) {
+                    return;
+                }
+            }
+        });
+    }
+
+    // Owner: push in bursts, popping some back, then drain what is left
+    for (int i = 0; i < kItems; ++i) {
+        deque.Push(&items[i]);
+        if (i % 3 == 0) {
+            if (int* item = deque.Pop()) {
+                counts[*item].fetch_add(1);
+            }
+        }
+    }
+    while (int* item = deque.Pop()) {
+        counts[*item].fetch_add(1);
+    }
+    owner_done.store(true, std::memory_order_release);
+    for (auto& thief : thieves) {
+        thief.join();
+    }
+
+    CHECK(AllOnce(counts));
+}
+
+struct Task {
+    int id;
+};
+
+void TestSchedulerRunsEveryTaskOnce() {
+    constexpr int kWorkers = 8;
+    constexpr int kProducers = 4;
+    constexpr int kRoots = 40000;
+    constexpr int kFanout = 3;  // Subtasks per root, forked onto the worker's deque
+    constexpr int kTotal = kRoots * (1 + kFanout);
+
+    // Inbox of 8 so bursts spill into the overflow queue
+    WorkStealingScheduler<Task> scheduler(kWorkers, 8);
+    std::vector<std::atomic<int>> counts(kTotal);
+    std::atomic<int> done(0);
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < kWorkers; ++w) {
+        workers.emplace_back([&, w]() {
+            while (std::unique_ptr<Task> task = scheduler.Next(w)) {
+                if (task->id < kRoots) {
+                    for (int k = 0; k < kFanout; ++k) {
+                        scheduler.SubmitLocal(w, std::unique_ptr<Task>(
+                                                     new Task{kRoots + task->id * kFanout + k}));
+                    }
+                }
+                counts[task->id].fetch_add(1);
+                if (done.fetch_add(1) + 1 == kTotal) {
+                    std::lock_guard<std::mutex> lock(done_mutex);
+                    done_cv.notify_all();
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int id = p; id < kRoots; id += kProducers) {
+                scheduler.Submit(std::unique_ptr<Task>(new Task{id}));
+            }
+        });
+    }
+
+    // Shrink and grow the pool while tasks are queued on every worker
+    std::thread resizer([&]() {
+        for (int round = 0; round < 200 && done.load() < kTotal; ++round) {
+            scheduler.SetActiveWorkers(1 + round % kWorkers);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        scheduler.SetActiveWorkers(kWorkers);
+    });
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    resizer.join();
+    {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        bool finished = done_cv.wait_for(lock, kTimeout, [&]() { return done.load() == kTotal; });
+        CHECK(finished);
+    }
+    scheduler.Stop();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    CHECK(done.load() == kTotal);
+    CHECK(AllOnce(counts));
+}
+
+void TestParkedWorkersWakeAndStopDrains() {
+    constexpr int kWorkers = 3;
+    constexpr int kRounds = 20000;
+    constexpr int kQueuedAtStop = 1000;
+
+    WorkStealingScheduler<Task> scheduler(kWorkers);
+    std::atomic<int> ran(0);
+    std::mutex ran_mutex;
+    std::condition_variable ran_cv;
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < kWorkers; ++w) {
+        workers.emplace_back([&, w]() {
+            while (std::unique_ptr<Task> task = scheduler.Next(w)) {
+                {
+                    std::lock_guard<std::mutex> lock(ran_mutex);
+                    ran.fetch_add(1);
+                }
+                ran_cv.notify_all();
+            }
+        });
+    }
+
+    // One task at a time, so each submit finds the workers parked or about
+    // to park. Vary the gap to hit both sides of the park protocol.
+    for (int round = 0; round < kRounds; ++round) {
+        if (round % 64 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        } else if (round % 2 == 0) {
+            std::this_thread::yield();
+        }
+        scheduler.Submit(std::unique_ptr<Task>(new Task{round}));
+        std::unique_lock<std::mutex> lock(ran_mutex);
+        if (!ran_cv.wait_for(lock, kTimeout, [&]() { return ran.load() == round + 1; })) {
+            std::fprintf(stderr, "round %d: task not run, lost wakeup\n", round);
+            ++failures;
+            break;
+        }
+    }
+
+    // Tasks queued before Stop are still run; then every worker returns
+    int before = ran.load();
+    for (int i = 0; i < kQueuedAtStop; ++i) {
+        scheduler.Submit(std::unique_ptr<Task>(new Task{i}));
+    }
+    scheduler.Stop();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    CHECK(ran.load() == before + kQueuedAtStop);
+}
+
+}  // namespace
+
+int main() {
+    TestDequePushPopSteal();
+    TestSchedulerRunsEveryTaskOnce();
+    TestParkedWorkersWakeAndStopDrains();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "scheduler_test: %d failure(s)\n", failures);
+        return 1;
+    }
+    std::printf("scheduler_test: OK\n");
+    return 0;
+}